@@ -8,7 +8,7 @@ set msvc=^"C:\Program Files (x86)\Microsoft Visual Studio\2019\Community\VC\Auxi
 
 set warning_exeptions=-wd4100 -wd4201
 set common_compiler_flags= -MTd -GR -EHa-  %optimization% -Oi -W4 %warning_exeptions% -nologo -FC -Z7
-set common_linker_flags=-incremental:no -opt:ref user32.lib gdi32.lib opengl32.lib
+set common_linker_flags=-incremental:no -opt:ref user32.lib gdi32.lib opengl32.lib synchronization.lib
 
 if not exist run_tree mkdir run_tree
 pushd run_tree
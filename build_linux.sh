@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# Usage: ./build_linux.sh [x11|headless|egl]
+# x11:      window with a GLX context, see src/linux/linux_x11.c.
+# headless: no window and no GPU, see src/linux/linux_headless.c.
+# egl:      no window, real OpenGL through EGL, see src/linux/linux_egl.c.
+
+OUTPUT_DIR="run_tree/"
+BACKEND="${1:-x11}"
+
+if [ ! -d "$OUTPUT_DIR" ]; then
+    mkdir run_tree
+fi
+
+FLAGS="-O2 -g -D_GNU_SOURCE -fno-strict-aliasing"
+WARNINGS="-Wno-write-strings -Wno-deprecated-declarations -Wno-comment -Wno-switch -Wno-unused-result -Wno-incompatible-pointer-types -Wno-pointer-sign"
+
+case "$BACKEND" in
+    x11)
+        gcc $WARNINGS -DBUILD_LINUX $FLAGS -o $OUTPUT_DIR/app ./src/app.c -lm -lpthread -lX11 -lXi -lGL
+        ;;
+    headless)
+        gcc $WARNINGS -DBUILD_HEADLESS $FLAGS -o $OUTPUT_DIR/app ./src/app.c -lm -lpthread
+        ;;
+    egl)
+        gcc $WARNINGS -DBUILD_EGL $FLAGS -o $OUTPUT_DIR/app ./src/app.c -lm -lpthread -lEGL -lGL
+        ;;
+    *)
+        echo "Unknown backend '$BACKEND'."
+        exit 1
+        ;;
+esac
@@ -7,39 +7,61 @@
 #include "memory.h"
 #define STRING_IMPL
 #include "string.h"
+#define FILE_IMPL
+#include "file.h"
+#define PROFILE_IMPL
+#include "profile.h"
+#define JOBS_IMPL
+#include "jobs.h"
+#define FIBERS_IMPL
+#include "fibers.h"
+#define RECORD_IMPL
+#include "record.h"
+#define LOG_IMPL
+#include "log.h"
 #include "key_input.h"
 #include "opengl.h"
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "ext/stb_truetype.h"
 #define UI_IMPL
 #include "ui.h"
+#define FRAME_STATS_IMPL
+#include "frame_stats.h"
+#define TELEMETRY_IMPL
+#include "telemetry.h"
 #include "app.h"
 
 static App_Data *app_data = 0;
 
 static void app_process_events() {
-    for (u32 i = 0; i < platform_state->event_count; ++i) {
-        Platform_Event *event = &platform_state->events[i];
+    ProfileBegin("app_process_events");
+    Platform_Event next_event;
+    while (platform_next_event(&next_event)) {
+        Platform_Event *event = &next_event;
+        if (app_data->recorder) input_recorder_event(app_data->recorder, event);
         switch (event->type) {
 
             case Platform_Event_Type_Key_Press: {
-                platform_log("%s pressed!\n", get_key_name(event->key).str);
+                LogInfo("%s pressed!\n", get_key_name(event->key).str);
+                if (event->key == KEY_F3) app_data->show_frame_stats = !app_data->show_frame_stats;
             } break;
 
             case Platform_Event_Type_Key_Release: {
-                platform_log("%s released!\n", get_key_name(event->key).str);
+                LogInfo("%s released!\n", get_key_name(event->key).str);
             } break;
 
             case Platform_Event_Type_Character_Input: {
-                platform_log("%c typed!\n", (char)event->character);
+                u8 utf8[4];
+                u32 size = str_utf8_encode(utf8, event->character);
+                LogInfo("%.*s typed!\n", size, utf8);
             } break;
 
             case Platform_Event_Type_Mouse_Press: {
-                platform_log("%s pressed!\n", get_key_name(event->key).str);
+                LogInfo("%s pressed!\n", get_key_name(event->key).str);
             } break;
 
             case Platform_Event_Type_Mouse_Release: {
-                platform_log("%s released!\n", get_key_name(event->key).str);
+                LogInfo("%s released!\n", get_key_name(event->key).str);
             } break;
 
             case Platform_Event_Type_Mouse_Move: {
@@ -47,15 +69,15 @@ static void app_process_events() {
             } break;
 
             case Platform_Event_Type_Cursor_Enter: {
-                platform_log("cursor enter\n");
+                LogInfo("cursor enter\n");
             } break;
 
             case Platform_Event_Type_Cursor_Leave: {
-                platform_log("cursor leave\n");
+                LogInfo("cursor leave\n");
             } break;
         }
     }
-    platform_state->event_count = 0;
+    ProfileEnd();
 }
 
 static UI_State *ui = 0;
@@ -72,7 +94,54 @@ void app_init() {
     app_data->frame_arena = PushStruct(arena, Mem_Arena);
     *app_data->frame_arena = mem_arena_init(GB(1));
 
-    platform_state->events = PushData(arena, Platform_Event, PLATFORM_MAX_EVENTS);
+    ProfileInit();
+    log_init(0, 0);
+    char *log_file = getenv("APP_LOG_FILE");
+    if (log_file && !log_open_binary(log_file)) {
+        LogError("Failed to create the binary log '%s'.\n", log_file);
+    }
+    job_system_init(0);
+
+    app_data->frame_stats = PushStruct(arena, Frame_Stats);
+    frame_stats_init(app_data->frame_stats);
+    char *show_frame_stats = getenv("APP_FRAME_STATS");
+    app_data->show_frame_stats = show_frame_stats && atoi(show_frame_stats);
+
+    char *telemetry_name = getenv("APP_TELEMETRY");
+    if (telemetry_name) {
+        app_data->telemetry = PushStructZero(arena, Telemetry);
+        if (telemetry_create(app_data->telemetry, telemetry_name)) {
+            LogInfo("Publishing telemetry as '%s'.\n", telemetry_name);
+        } else {
+            LogError("Failed to create the telemetry block '%s'.\n", telemetry_name);
+            app_data->telemetry = 0;
+        }
+    }
+
+    // Frames only run on input, the animation below requests the rest.
+    platform_set_frame_mode(Platform_Frame_Mode_On_Demand);
+
+    char *record_file = getenv("APP_RECORD");
+    char *replay_file = getenv("APP_REPLAY");
+    if (replay_file) {
+        app_data->replay = PushStructZero(arena, Input_Replay);
+        if (input_replay_open(replay_file, app_data->replay)) {
+            platform_set_raw_mouse_events(1);
+            platform_set_live_events(0);
+            LogInfo("Replaying input from '%s'.\n", replay_file);
+        } else {
+            LogError("Failed to open input recording '%s'.\n", replay_file);
+            app_data->replay = 0;
+        }
+    } else if (record_file) {
+        app_data->recorder = PushStructZero(arena, Input_Recorder);
+        if (input_recorder_open(arena, record_file, app_data->recorder)) {
+            LogInfo("Recording input to '%s'.\n", record_file);
+        } else {
+            LogError("Failed to create input recording '%s'.\n", record_file);
+            app_data->recorder = 0;
+        }
+    }
 
     load_gl_functions();
 
@@ -102,15 +171,70 @@ void render_triangle_gradient(f32 time) {
     glEnd();
 }
 
+static void app_publish_telemetry() {
+    Frame_Stats *stats = app_data->frame_stats;
+    Platform_Event_Queue *events = &platform_state->events;
+    Job_Stats jobs = job_get_stats();
+
+    Telemetry_Frame frame = {0};
+    {
+        frame.time_ns               = platform_get_time_ns();
+        frame.frame_us              = (u32)(platform_state->delta_ns / 1000);
+        frame.update_us             = frame_stats_get_last_us(stats, Frame_Stats_Metric_Update);
+        frame.render_us             = frame_stats_get_last_us(stats, Frame_Stats_Metric_Render);
+        frame.budget_us             = (u32)(frame_stats_get_budget(stats) * 1000.0);
+        frame.hitches               = stats->hitches;
+        frame.missed_frames         = stats->missed_frames;
+        frame.arena_used            = app_data->arena->alloc_pos;
+        frame.arena_committed       = app_data->arena->commit_pos;
+        frame.frame_arena_used      = app_data->frame_arena->alloc_pos;
+        frame.frame_arena_committed = app_data->frame_arena->commit_pos;
+        frame.events_depth          = platform_event_queue_depth();
+        frame.events_max_depth      = atomic_load_u64(&events->max_depth);
+        frame.events_pushed         = atomic_load_u64(&events->pushed);
+        frame.events_coalesced      = atomic_load_u64(&events->coalesced);
+        frame.events_dropped        = atomic_load_u64(&events->dropped);
+        frame.job_workers           = jobs.workers;
+        frame.job_sleeping          = jobs.sleeping;
+        frame.jobs_queued           = jobs.queued;
+        frame.jobs_executed         = jobs.executed;
+    }
+    telemetry_publish(app_data->telemetry, &frame);
+}
+
 void app_update() {
     mem_arena_clear(app_data->frame_arena);
 
+    if (app_data->replay) {
+        // Live events are off, this only drops what was queued before
+        // the replay started.
+        Platform_Event live_event;
+        while (platform_next_event(&live_event));
+
+        if (!input_replay_next_frame(app_data->replay)) {
+            LogInfo("Replayed %llu frames.\n", app_data->replay->frames);
+            input_replay_close(app_data->replay);
+            app_data->replay = 0;
+            atomic_store_u32(&platform_state->running, 0);
+            return;
+        }
+    } else if (app_data->recorder) {
+        input_recorder_begin_frame(app_data->recorder);
+    }
+    frame_stats_begin_frame(app_data->frame_stats);
+
+    ProfileBegin("app_update");
+    platform_input_begin_frame();
     app_process_events();
+    platform_async_io_poll();
 
     glClear(GL_COLOR_BUFFER_BIT);
 
-    static f32 time = 0;
-    time += platform_state->delta;
+    // Summed in ns, an f32 sum of deltas drifts over a long session.
+    static u64 time_ns = 0;
+    time_ns += platform_state->delta_ns;
+    f32 time = (f32)((f64)time_ns / 1000000000.0);
+    platform_request_frame();
     render_triangle_gradient(time);
     
     ui_begin(ui, platform_state);
@@ -144,12 +268,45 @@ void app_update() {
     box3->size[UI_Axis_Y] = ui_text_content_size(10.0f);
     box3->style.background = vec4(0.5f, 0.5f, 0.5f, 1.0f);
     box3->style.text       = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+
+    if (app_data->show_frame_stats) frame_stats_overlay(app_data->frame_stats);
     
     ui_end();
+    frame_stats_end_update(app_data->frame_stats);
 
     ui_render(ui);
 
-    platform_swap_buffers();
+    ProfileScope("platform_swap_buffers") {
+        platform_swap_buffers();
+    }
+    frame_stats_end_render(app_data->frame_stats);
+    if (app_data->telemetry) app_publish_telemetry();
+    ProfileEnd();
+    ProfileFrameEnd();
+}
+
+// Called by the platform layer once the main loop is left.
+void app_shutdown() {
+    if (app_data->recorder) {
+        LogInfo("Recorded %llu frames with %llu events.\n", app_data->recorder->frames, app_data->recorder->events);
+        input_recorder_close(app_data->recorder);
+        app_data->recorder = 0;
+    }
+    if (app_data->replay) {
+        input_replay_close(app_data->replay);
+        app_data->replay = 0;
+    }
+    if (app_data->telemetry) {
+        telemetry_close(app_data->telemetry);
+        app_data->telemetry = 0;
+    }
+#if PROFILE_ENABLED
+    char *trace_file = getenv("APP_PROFILE_TRACE");
+    if (trace_file && !profile_write_trace(app_data->arena, trace_file)) {
+        LogError("Failed to write the profile trace '%s'.\n", trace_file);
+    }
+#endif
+    log_shutdown();
 }
 
 
@@ -160,6 +317,12 @@ void app_update() {
 #include "win32/win32_app.c"
 #elif defined(BUILD_MACOS)
 #include "mac/mac_app.m"
+#elif defined(BUILD_HEADLESS)
+#include "linux/linux_headless.c"
+#elif defined(BUILD_EGL)
+#include "linux/linux_egl.c"
+#elif defined(BUILD_LINUX)
+#include "linux/linux_x11.c"
 #else
 #error The specified platform is not yet supported. Make sure the correct define is set in the build file.
 #endif
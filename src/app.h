@@ -6,6 +6,11 @@ struct App_Data {
     Mem_Arena *arena;
     Mem_Arena *frame_arena;
     ivec2 mouse_pos; // Maybe make this a float vec2?
+    Input_Recorder *recorder; // Set with APP_RECORD=<file>.
+    Input_Replay *replay;     // Set with APP_REPLAY=<file>.
+    Frame_Stats *frame_stats;
+    b32 show_frame_stats;     // Toggled with F3, or set with APP_FRAME_STATS=1.
+    Telemetry *telemetry;     // Set with APP_TELEMETRY=<name>.
 };
 
 #endif
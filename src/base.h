@@ -2,11 +2,26 @@
 #define BASE_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
 
+// SIMD intrinsics for the vectorized fast paths. Everything that uses
+// them also has a scalar fallback, so neither define is required.
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define BASE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define BASE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 // +============+
 // | DEFINTIONS |
 // +============+
@@ -26,21 +41,80 @@ typedef s32 b32;
 typedef float f32;
 typedef double f64;
 
+// Strings are sized byte views and are not null-terminated. The string
+// functions live in string.h, the type is here so that every layer, the
+// platform layer included, can pass them around.
+typedef struct String String;
+struct String {
+    u8 *str;
+    u64 size;
+};
+
 
 // +===============+
 // | HELPER MACROS |
 // +===============+
 
 #define ArrayCount(Array) (sizeof(Array) / sizeof((Array)[0]))
+#define Min(a, b) (((a) < (b)) ? (a) : (b))
+#define Max(a, b) (((a) > (b)) ? (a) : (b))
+#define AlignPow2(x, b) (((x) + (b) - 1) & ~((b) - 1))
 
 // These are actually KiB, MiB,... but everyone knows that it is a power of two.
 #define KB(n) ((n) << 10)
 #define MB(n) ((n) << 20)
 #define GB(n) ((u64)(n) << 30)
 
+#if defined(_MSC_VER)
+#define ThreadLocal __declspec(thread)
+#else
+#define ThreadLocal __thread
+#endif
+
 #define Assert(expression) if(!(expression)) { *(int *)0 = 0; }
 
 
+/////////////////////////////
+// Bit scanning
+static inline u32 count_trailing_zeros_u32(u32 n) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, n);
+    return (u32)index;
+#else
+    return (u32)__builtin_ctz(n);
+#endif
+}
+
+static inline u32 count_trailing_zeros_u64(u64 n) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, n);
+    return (u32)index;
+#else
+    return (u32)__builtin_ctzll(n);
+#endif
+}
+
+static inline u32 count_leading_zeros_u64(u64 n) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, n);
+    return 63 - (u32)index;
+#else
+    return (u32)__builtin_clzll(n);
+#endif
+}
+
+static inline u32 pop_count_u64(u64 n) {
+#if defined(_MSC_VER)
+    return (u32)__popcnt64(n);
+#else
+    return (u32)__builtin_popcountll(n);
+#endif
+}
+
+
 
 /////////////////////////////
 // Stack
@@ -0,0 +1,255 @@
+/* fibers.h - v0.1 - Sven A. Schreiber
+ *
+ * fibers.h is a single header file library for cooperative tasks. It
+ * is part of and depends on my C base-layer.
+ *
+ * A fiber runs linear code that may wait on asynchronous I/O or on a
+ * job counter. Waiting switches back to the scheduler, which resumes
+ * the fiber in a later update once the I/O or the jobs are done. All
+ * fibers of a scheduler run on the thread that updates it, so they
+ * never race each other and need no locks between them.
+ *
+ * To use this file simply define FIBERS_IMPL once at the start of
+ * your project before including it. After that you can include it
+ * without defining FIBERS_IMPL as per usual.
+ *
+ * Example:
+ * ...
+ * #define FIBERS_IMPL
+ * #include "fibers.h"
+ * ...
+ */
+
+#ifndef FIBERS_H
+#define FIBERS_H
+
+// +============+
+// | DEFINTIONS |
+// +============+
+
+#define FIBER_DEFAULT_STACK_SIZE KB(256)
+
+typedef void Fiber_Proc(void *data);
+
+typedef enum Fiber_Wait Fiber_Wait;
+enum Fiber_Wait {
+    Fiber_Wait_None,
+    Fiber_Wait_Yield,
+    Fiber_Wait_IO,
+    Fiber_Wait_Counter,
+};
+
+typedef struct Fiber_Scheduler Fiber_Scheduler;
+
+typedef struct Fiber Fiber;
+struct Fiber {
+    Platform_Fiber platform;
+    Fiber_Scheduler *scheduler;
+    Fiber_Proc *proc;
+    void *data;
+    Fiber_Wait wait;
+    void *wait_object;
+    b32 finished;
+    Fiber *next;
+};
+
+struct Fiber_Scheduler {
+    Mem_Arena *arena;
+    Platform_Fiber thread_fiber;
+    Fiber *first;
+    Fiber *last;
+    Fiber *free; // Finished fibers, their stacks are reused.
+    Fiber *current;
+    u64 stack_size;
+    u32 count;
+};
+
+
+// +===========+
+// | INTERFACE |
+// +===========+
+
+void fiber_scheduler_init(Fiber_Scheduler *scheduler, Mem_Arena *arena, u64 stack_size);
+void fiber_scheduler_release(Fiber_Scheduler *scheduler);
+Fiber *fiber_spawn(Fiber_Scheduler *scheduler, Fiber_Proc *proc, void *data);
+u32 fiber_scheduler_update(Fiber_Scheduler *scheduler);
+void fiber_scheduler_run(Fiber_Scheduler *scheduler);
+
+void fiber_yield();
+void fiber_wait_io(Platform_Async_IO *io);
+void fiber_wait_counter(Job_Counter *counter);
+b32 fiber_is_running();
+
+
+// +================+
+// | IMPLEMENTATION |
+// +================+
+
+#ifdef FIBERS_IMPL
+
+static ThreadLocal Fiber_Scheduler *fiber_current_scheduler;
+
+static void fiber_main(void *data) {
+    Fiber *fiber = (Fiber *)data;
+    for (;;) {
+        fiber->proc(fiber->data);
+        fiber->finished = 1;
+        // Resumed again only when the fiber is reused for a new proc.
+        platform_fiber_switch(&fiber->platform, &fiber->scheduler->thread_fiber);
+    }
+}
+
+// stack_size of 0 picks FIBER_DEFAULT_STACK_SIZE. Fibers and their stacks
+// are allocated from arena.
+void fiber_scheduler_init(Fiber_Scheduler *scheduler, Mem_Arena *arena, u64 stack_size) {
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->arena = arena;
+    scheduler->stack_size = stack_size ? stack_size : FIBER_DEFAULT_STACK_SIZE;
+    platform_fiber_init_from_thread(&scheduler->thread_fiber);
+}
+
+void fiber_scheduler_release(Fiber_Scheduler *scheduler) {
+    for (Fiber *fiber = scheduler->first; fiber; fiber = fiber->next) {
+        platform_fiber_release(&fiber->platform);
+    }
+    for (Fiber *fiber = scheduler->free; fiber; fiber = fiber->next) {
+        platform_fiber_release(&fiber->platform);
+    }
+    platform_fiber_release(&scheduler->thread_fiber);
+    memset(scheduler, 0, sizeof(*scheduler));
+}
+
+// The fiber first runs in the next update, also when it is spawned by
+// another fiber of the same scheduler during one. Returns 0 if no stack
+// could be reserved.
+Fiber *fiber_spawn(Fiber_Scheduler *scheduler, Fiber_Proc *proc, void *data) {
+    Fiber *fiber = scheduler->free;
+    if (fiber) {
+        Custom_Stack_Pop(scheduler, free, next);
+    } else {
+        fiber = PushStructZero(scheduler->arena, Fiber);
+        if (!platform_fiber_init(&fiber->platform, fiber_main, fiber, scheduler->stack_size)) {
+            platform_log("Failed to create a fiber.\n");
+            return 0;
+        }
+    }
+    fiber->scheduler   = scheduler;
+    fiber->proc        = proc;
+    fiber->data        = data;
+    fiber->wait        = Fiber_Wait_None;
+    fiber->wait_object = 0;
+    fiber->finished    = 0;
+    fiber->next        = 0;
+    Queue_PushBack(scheduler, fiber);
+    scheduler->count += 1;
+    return fiber;
+}
+
+static b32 fiber_is_ready(Fiber *fiber) {
+    switch (fiber->wait) {
+        case Fiber_Wait_IO: {
+            return ((Platform_Async_IO *)fiber->wait_object)->state != Platform_Async_IO_State_Pending;
+        }
+        case Fiber_Wait_Counter: {
+            return job_counter_is_done((Job_Counter *)fiber->wait_object);
+        }
+    }
+    return 1;
+}
+
+static u32 fiber_scheduler_resume_ready(Fiber_Scheduler *scheduler) {
+    platform_async_io_poll();
+
+    Fiber_Scheduler *previous = fiber_current_scheduler;
+    fiber_current_scheduler = scheduler;
+
+    // Fibers spawned during this pass are appended behind end and wait
+    // for the next one.
+    Fiber *end = scheduler->last;
+    u32 resumed = 0;
+    Fiber *prev = 0;
+    Fiber **link = &scheduler->first;
+    while (*link) {
+        Fiber *fiber = *link;
+        b32 at_end = fiber == end;
+        if (fiber_is_ready(fiber)) {
+            fiber->wait = Fiber_Wait_None;
+            scheduler->current = fiber;
+            platform_fiber_switch(&scheduler->thread_fiber, &fiber->platform);
+            scheduler->current = 0;
+            resumed += 1;
+        }
+
+        if (fiber->finished) {
+            *link = fiber->next;
+            if (scheduler->last == fiber) scheduler->last = prev;
+            fiber->next = 0;
+            Custom_Stack_Push(scheduler, fiber, free, next);
+            scheduler->count -= 1;
+        } else {
+            prev = fiber;
+            link = &fiber->next;
+        }
+        if (at_end) break;
+    }
+    fiber_current_scheduler = previous;
+    return resumed;
+}
+
+// Resumes every fiber whose wait is over once and returns the number of
+// fibers that are still alive.
+u32 fiber_scheduler_update(Fiber_Scheduler *scheduler) {
+    fiber_scheduler_resume_ready(scheduler);
+    return scheduler->count;
+}
+
+// Updates until every fiber has finished. While all of them wait, the
+// thread helps with queued jobs instead of sleeping.
+void fiber_scheduler_run(Fiber_Scheduler *scheduler) {
+    while (scheduler->count) {
+        if (!fiber_scheduler_resume_ready(scheduler) && !job_run_one()) {
+            platform_thread_yield();
+        }
+    }
+}
+
+static void fiber_suspend(Fiber_Wait wait, void *object) {
+    Fiber_Scheduler *scheduler = fiber_current_scheduler;
+    Fiber *fiber = scheduler->current;
+    fiber->wait = wait;
+    fiber->wait_object = object;
+    scheduler->current = 0;
+    platform_fiber_switch(&fiber->platform, &scheduler->thread_fiber);
+}
+
+b32 fiber_is_running() {
+    return fiber_current_scheduler && fiber_current_scheduler->current;
+}
+
+// Outside of a fiber the waits block the calling thread and yielding
+// does nothing.
+void fiber_yield() {
+    if (fiber_is_running()) fiber_suspend(Fiber_Wait_Yield, 0);
+}
+
+void fiber_wait_io(Platform_Async_IO *io) {
+    if (io->state != Platform_Async_IO_State_Pending) return;
+    if (fiber_is_running()) {
+        fiber_suspend(Fiber_Wait_IO, io);
+    } else {
+        platform_async_io_wait(io);
+    }
+}
+
+void fiber_wait_counter(Job_Counter *counter) {
+    if (job_counter_is_done(counter)) return;
+    if (fiber_is_running()) {
+        fiber_suspend(Fiber_Wait_Counter, counter);
+    } else {
+        job_wait(counter);
+    }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,294 @@
+/* file.h - v0.1 - Sven A. Schreiber
+ *
+ * file.h is a single header file library for streaming files in and
+ * out in fixed size blocks, so that files larger than memory can be
+ * processed. It is part of and depends on my C base-layer.
+ *
+ * Reads and writes are double buffered on top of the asynchronous
+ * I/O of the platform layer: while one block is being processed, the
+ * next one is already in flight.
+ * 
+ * To use this file simply define FILE_IMPL once at the start of
+ * your project before including it. After that you can include it 
+ * without defining FILE_IMPL as per usual.
+ * 
+ * Example:
+ * ...
+ * #define FILE_IMPL
+ * #include "file.h"
+ * ...
+ */
+
+#ifndef FILE_H
+#define FILE_H
+
+// +============+
+// | DEFINTIONS |
+// +============+
+
+#define FILE_DEFAULT_BLOCK_SIZE MB(1)
+
+typedef struct File_Reader File_Reader;
+struct File_Reader {
+    Platform_File_Handle file;
+    u64 file_size;
+    u64 block_size;
+    u64 read_offset;
+    u8 *buffers[2];
+    Platform_Async_IO io[2];
+    u32 current;
+    b32 has_chunk;
+    b32 failed;
+};
+
+// Writes go to "<file_name>.tmp", which replaces file_name only when the
+// writer is closed successfully, so readers never see a partial file.
+typedef struct File_Writer File_Writer;
+struct File_Writer {
+    Platform_File_Handle file;
+    char *file_name;
+    char *temp_file_name;
+    u64 block_size;
+    u64 write_offset;
+    u64 used;
+    u8 *buffers[2];
+    Platform_Async_IO io[2];
+    u32 current;
+    b32 failed;
+};
+
+typedef b32 File_Chunk_Callback(String chunk, u64 offset, void *user_data);
+
+
+// +===========+
+// | INTERFACE |
+// +===========+
+
+b32 file_reader_open(Mem_Arena *arena, char *file_name, u64 block_size, File_Reader *reader);
+b32 file_reader_next(File_Reader *reader, String *chunk);
+void file_reader_close(File_Reader *reader);
+b32 file_read_chunks(Mem_Arena *arena, char *file_name, u64 block_size, File_Chunk_Callback *callback, void *user_data);
+
+b32 file_writer_open(Mem_Arena *arena, char *file_name, u64 block_size, File_Writer *writer);
+void file_writer_write(File_Writer *writer, String data);
+void file_writer_write_list(File_Writer *writer, String_List *list);
+b32 file_writer_close(File_Writer *writer);
+void file_writer_abort(File_Writer *writer);
+
+
+// +================+
+// | IMPLEMENTATION |
+// +================+
+
+#ifdef FILE_IMPL
+
+// =========================
+// >> Reader
+
+static void file_reader_submit(File_Reader *reader, u32 index) {
+    Platform_Async_IO *io = &reader->io[index];
+    io->state = Platform_Async_IO_State_None;
+    if (reader->read_offset >= reader->file_size) return;
+
+    u64 remaining = reader->file_size - reader->read_offset;
+    io->op     = Platform_Async_IO_Op_Read;
+    io->file   = reader->file;
+    io->offset = reader->read_offset;
+    io->buffer = reader->buffers[index];
+    io->size   = remaining < reader->block_size ? remaining : reader->block_size;
+    reader->read_offset += io->size;
+    platform_async_io_submit(io);
+}
+
+b32 file_reader_open(Mem_Arena *arena, char *file_name, u64 block_size, File_Reader *reader) {
+    memset(reader, 0, sizeof(*reader));
+    reader->file = platform_open_file(file_name, Platform_File_Flag_Read);
+    if (!platform_file_handle_is_valid(reader->file)) {
+        return 0;
+    }
+
+    reader->file_size  = platform_get_file_size(reader->file);
+    reader->block_size = block_size ? block_size : FILE_DEFAULT_BLOCK_SIZE;
+    reader->buffers[0] = PushData(arena, u8, reader->block_size);
+    reader->buffers[1] = PushData(arena, u8, reader->block_size);
+
+    file_reader_submit(reader, 0);
+    file_reader_submit(reader, 1);
+    return 1;
+}
+
+// Returns the next block of the file. The chunk stays valid until the
+// next call, after which its buffer is reused for reading ahead.
+b32 file_reader_next(File_Reader *reader, String *chunk) {
+    if (reader->has_chunk) {
+        file_reader_submit(reader, reader->current);
+        reader->current ^= 1;
+        reader->has_chunk = 0;
+    }
+
+    Platform_Async_IO *io = &reader->io[reader->current];
+    if (io->state == Platform_Async_IO_State_None) return 0;
+
+    platform_async_io_wait(io);
+    if (io->state == Platform_Async_IO_State_Failed) {
+        reader->failed = 1;
+        return 0;
+    }
+    if (io->bytes_transferred == 0) return 0;
+
+    chunk->str  = io->buffer;
+    chunk->size = io->bytes_transferred;
+    reader->has_chunk = 1;
+    return 1;
+}
+
+void file_reader_close(File_Reader *reader) {
+    // Outstanding reads still point into our buffers.
+    for (u32 i = 0; i < 2; ++i) {
+        platform_async_io_wait(&reader->io[i]);
+    }
+    platform_close_file(reader->file);
+    reader->file.value = PLATFORM_INVALID_FILE_HANDLE;
+}
+
+// Calls callback for every block of the file, stops early when it returns 0.
+b32 file_read_chunks(Mem_Arena *arena, char *file_name, u64 block_size, File_Chunk_Callback *callback, void *user_data) {
+    File_Reader reader;
+    if (!file_reader_open(arena, file_name, block_size, &reader)) {
+        return 0;
+    }
+
+    u64 offset = 0;
+    String chunk;
+    while (file_reader_next(&reader, &chunk)) {
+        if (!callback(chunk, offset, user_data)) break;
+        offset += chunk.size;
+    }
+    file_reader_close(&reader);
+    return !reader.failed;
+}
+
+
+// =========================
+// >> Writer
+
+b32 file_writer_open(Mem_Arena *arena, char *file_name, u64 block_size, File_Writer *writer) {
+    memset(writer, 0, sizeof(*writer));
+
+    u64 name_size = strlen(file_name);
+    writer->file_name = PushData(arena, char, name_size + 1);
+    memcpy(writer->file_name, file_name, name_size + 1);
+    writer->temp_file_name = PushData(arena, char, name_size + 5);
+    memcpy(writer->temp_file_name, file_name, name_size);
+    memcpy(writer->temp_file_name + name_size, ".tmp", 5);
+
+    writer->file = platform_open_file(writer->temp_file_name, Platform_File_Flag_Write | Platform_File_Flag_Create | Platform_File_Flag_Truncate);
+    if (!platform_file_handle_is_valid(writer->file)) {
+        return 0;
+    }
+
+    writer->block_size = block_size ? block_size : FILE_DEFAULT_BLOCK_SIZE;
+    writer->buffers[0] = PushData(arena, u8, writer->block_size);
+    writer->buffers[1] = PushData(arena, u8, writer->block_size);
+    return 1;
+}
+
+static void file_writer_wait(File_Writer *writer, u32 index) {
+    Platform_Async_IO *io = &writer->io[index];
+    platform_async_io_wait(io);
+    if (io->state == Platform_Async_IO_State_Failed) {
+        writer->failed = 1;
+    }
+}
+
+// Sends the current buffer off and continues in the other one, once its
+// previous write has finished.
+static void file_writer_flush_current(File_Writer *writer) {
+    if (writer->used == 0) return;
+
+    Platform_Async_IO *io = &writer->io[writer->current];
+    io->op     = Platform_Async_IO_Op_Write;
+    io->file   = writer->file;
+    io->offset = writer->write_offset;
+    io->buffer = writer->buffers[writer->current];
+    io->size   = writer->used;
+    platform_async_io_submit(io);
+
+    writer->write_offset += writer->used;
+    writer->used = 0;
+    writer->current ^= 1;
+    file_writer_wait(writer, writer->current);
+}
+
+void file_writer_write(File_Writer *writer, String data) {
+    while (data.size > 0) {
+        u64 free_space = writer->block_size - writer->used;
+        u64 size = data.size < free_space ? data.size : free_space;
+        memcpy(writer->buffers[writer->current] + writer->used, data.str, size);
+        writer->used += size;
+        data = str_substring(data, size, data.size);
+
+        if (writer->used == writer->block_size) {
+            file_writer_flush_current(writer);
+        }
+    }
+}
+
+// Writes all nodes in order, e.g. the chunks of a String_Builder, without
+// joining them first. Lists smaller than a block are copied into the
+// buffer like any other write. Larger ones go straight from the nodes
+// to the file with vectored writes, after the buffered data.
+void file_writer_write_list(File_Writer *writer, String_List *list) {
+    if (list->combined_size < writer->block_size) {
+        for (String_List_Node *node = list->first; node; node = node->next) {
+            file_writer_write(writer, node->string);
+        }
+        return;
+    }
+
+    file_writer_flush_current(writer);
+    String batch[64];
+    u32 count = 0;
+    for (String_List_Node *node = list->first; node; node = node->next) {
+        batch[count++] = node->string;
+        if (count < ArrayCount(batch) && node->next) continue;
+
+        u64 size = 0;
+        for (u32 i = 0; i < count; ++i) size += batch[i].size;
+        if (!writer->failed && !platform_write_file_gather(writer->file, writer->write_offset, batch, count)) {
+            writer->failed = 1;
+        }
+        writer->write_offset += size;
+        count = 0;
+    }
+}
+
+b32 file_writer_close(File_Writer *writer) {
+    file_writer_flush_current(writer);
+    file_writer_wait(writer, 0);
+    file_writer_wait(writer, 1);
+
+    b32 ok = !writer->failed && platform_flush_file(writer->file);
+    platform_close_file(writer->file);
+    writer->file.value = PLATFORM_INVALID_FILE_HANDLE;
+
+    if (ok) {
+        ok = platform_rename_file(writer->temp_file_name, writer->file_name);
+    }
+    if (!ok) {
+        platform_delete_file(writer->temp_file_name);
+    }
+    return ok;
+}
+
+void file_writer_abort(File_Writer *writer) {
+    file_writer_wait(writer, 0);
+    file_writer_wait(writer, 1);
+    platform_close_file(writer->file);
+    writer->file.value = PLATFORM_INVALID_FILE_HANDLE;
+    platform_delete_file(writer->temp_file_name);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,327 @@
+/* frame_stats.h - v0.1 - Sven A. Schreiber
+ *
+ * frame_stats.h is a single header file library for measuring how
+ * long frames take. It is part of and depends on my C base-layer.
+ *
+ * Three times are taken per frame: the frame time from the start of
+ * one frame to the start of the next, the update time up to
+ * frame_stats_end_update and the render time from there up to
+ * frame_stats_end_render. The frame after an idle wait of the platform
+ * layer has no frame time, waiting for input is not slow.
+ *
+ * Each time goes into a window of the last FRAME_STATS_WINDOW samples
+ * and its histogram. The buckets grow with the value, 16 per power of
+ * two, so percentiles are off by at most 1/32 of the value. The max is
+ * taken from the samples themselves. A frame is a hitch if it takes
+ * longer than the budget, which is 1/target_fps of the platform layer
+ * unless it is set explicitly, and the frames it took longer count as
+ * missed.
+ *
+ * The stats can be read with frame_stats_get_summary, drawn on top of
+ * the UI with frame_stats_overlay, and are written to the log every
+ * log_interval_ms.
+ *
+ * To use this file simply define FRAME_STATS_IMPL once at the start of
+ * your project before including it. After that you can include it
+ * without defining FRAME_STATS_IMPL as per usual.
+ *
+ * Example:
+ * ...
+ * #define FRAME_STATS_IMPL
+ * #include "frame_stats.h"
+ * ...
+ * frame_stats_begin_frame(&stats);
+ * update();
+ * frame_stats_end_update(&stats);
+ * render();
+ * frame_stats_end_render(&stats);
+ * ...
+ */
+
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+// +============+
+// | DEFINTIONS |
+// +============+
+
+#define FRAME_STATS_WINDOW           600  // Samples, 10 seconds at 60 fps.
+#define FRAME_STATS_SUB_BUCKET_BITS  4
+#define FRAME_STATS_SUB_BUCKETS      (1 << FRAME_STATS_SUB_BUCKET_BITS)
+#define FRAME_STATS_BUCKETS          (23 * FRAME_STATS_SUB_BUCKETS) // Up to 2^26 us.
+#define FRAME_STATS_DEFAULT_FPS      60
+#define FRAME_STATS_LOG_INTERVAL_MS  5000
+
+typedef enum Frame_Stats_Metric Frame_Stats_Metric;
+enum Frame_Stats_Metric {
+    Frame_Stats_Metric_Frame,
+    Frame_Stats_Metric_Update,
+    Frame_Stats_Metric_Render,
+    Frame_Stats_Metric_Count
+};
+
+// Samples are stored in microseconds.
+typedef struct Frame_Stats_Window Frame_Stats_Window;
+struct Frame_Stats_Window {
+    u32 samples[FRAME_STATS_WINDOW];
+    u32 histogram[FRAME_STATS_BUCKETS];
+    u32 count;
+    u32 next;
+    u64 sum;
+};
+
+typedef struct Frame_Stats_Summary Frame_Stats_Summary;
+struct Frame_Stats_Summary {
+    u32 count;
+    f64 mean_ms;
+    f64 p50_ms;
+    f64 p95_ms;
+    f64 p99_ms;
+    f64 max_ms;
+};
+
+typedef struct Frame_Stats Frame_Stats;
+struct Frame_Stats {
+    Frame_Stats_Window windows[Frame_Stats_Metric_Count];
+    f64 budget_ms; // 0 follows target_fps.
+    u32 log_interval_ms; // 0 turns the log line off.
+    u64 frames;
+    u64 hitches;
+    u64 missed_frames;
+    u64 frame_start_ns;
+    u64 update_end_ns;
+    u64 idle_waits;
+    u64 last_log_ns;
+};
+
+
+// +===========+
+// | INTERFACE |
+// +===========+
+
+void frame_stats_init(Frame_Stats *stats);
+void frame_stats_set_budget(Frame_Stats *stats, f64 budget_ms);
+f64 frame_stats_get_budget(Frame_Stats *stats);
+void frame_stats_begin_frame(Frame_Stats *stats);
+void frame_stats_end_update(Frame_Stats *stats);
+void frame_stats_end_render(Frame_Stats *stats);
+void frame_stats_add(Frame_Stats *stats, Frame_Stats_Metric metric, u64 ns);
+Frame_Stats_Summary frame_stats_get_summary(Frame_Stats *stats, Frame_Stats_Metric metric);
+u32 frame_stats_get_last_us(Frame_Stats *stats, Frame_Stats_Metric metric);
+u32 frame_stats_get_window_hitches(Frame_Stats *stats);
+void frame_stats_log(Frame_Stats *stats);
+void frame_stats_overlay(Frame_Stats *stats);
+
+
+// +================+
+// | IMPLEMENTATION |
+// +================+
+
+#ifdef FRAME_STATS_IMPL
+
+static char *frame_stats_metric_names[Frame_Stats_Metric_Count] = {
+    "frame",
+    "update",
+    "render",
+};
+
+// =========================
+// >> Histogram
+
+// Values below FRAME_STATS_SUB_BUCKETS get a bucket each, above that
+// every power of two is split into FRAME_STATS_SUB_BUCKETS buckets.
+static u32 frame_stats_bucket_from_us(u32 us) {
+    if (us < FRAME_STATS_SUB_BUCKETS) return us;
+    u32 exponent = 31;
+    while (!(us & (1u << exponent))) exponent -= 1;
+    u32 shift = exponent - FRAME_STATS_SUB_BUCKET_BITS;
+    u32 bucket = (shift + 1) * FRAME_STATS_SUB_BUCKETS + ((us >> shift) & (FRAME_STATS_SUB_BUCKETS - 1));
+    return Min(bucket, FRAME_STATS_BUCKETS - 1);
+}
+
+// The middle of the bucket.
+static f64 frame_stats_us_from_bucket(u32 bucket) {
+    if (bucket < FRAME_STATS_SUB_BUCKETS) return (f64)bucket;
+    u32 shift = bucket / FRAME_STATS_SUB_BUCKETS - 1;
+    u32 sub = bucket % FRAME_STATS_SUB_BUCKETS;
+    f64 low = (f64)((u64)(FRAME_STATS_SUB_BUCKETS + sub) << shift);
+    return low + (f64)((u64)1 << shift) * 0.5;
+}
+
+static void frame_stats_window_add(Frame_Stats_Window *window, u32 us) {
+    if (window->count == FRAME_STATS_WINDOW) {
+        u32 old = window->samples[window->next];
+        window->histogram[frame_stats_bucket_from_us(old)] -= 1;
+        window->sum -= old;
+    } else {
+        window->count += 1;
+    }
+    window->samples[window->next] = us;
+    window->histogram[frame_stats_bucket_from_us(us)] += 1;
+    window->sum += us;
+    window->next = (window->next + 1) % FRAME_STATS_WINDOW;
+}
+
+
+// =========================
+// >> Stats
+
+void frame_stats_init(Frame_Stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->log_interval_ms = FRAME_STATS_LOG_INTERVAL_MS;
+    stats->last_log_ns = platform_get_time_ns();
+}
+
+void frame_stats_set_budget(Frame_Stats *stats, f64 budget_ms) {
+    stats->budget_ms = budget_ms;
+}
+
+f64 frame_stats_get_budget(Frame_Stats *stats) {
+    if (stats->budget_ms > 0) return stats->budget_ms;
+    u32 fps = atomic_load_u32(&platform_state->pacing.target_fps);
+    return 1000.0 / (f64)(fps ? fps : FRAME_STATS_DEFAULT_FPS);
+}
+
+void frame_stats_add(Frame_Stats *stats, Frame_Stats_Metric metric, u64 ns) {
+    u64 us = ns / 1000;
+    frame_stats_window_add(&stats->windows[metric], (u32)Min(us, 0xFFFFFFFFull));
+
+    if (metric == Frame_Stats_Metric_Frame) {
+        stats->frames += 1;
+        f64 budget_us = frame_stats_get_budget(stats) * 1000.0;
+        if ((f64)us > budget_us) {
+            stats->hitches += 1;
+            stats->missed_frames += (u64)((f64)us / budget_us);
+        }
+    }
+}
+
+void frame_stats_begin_frame(Frame_Stats *stats) {
+    u64 now = platform_get_time_ns();
+    u64 idle_waits = platform_state->pacing.idle_waits;
+    if (stats->frame_start_ns && idle_waits == stats->idle_waits) {
+        frame_stats_add(stats, Frame_Stats_Metric_Frame, now - stats->frame_start_ns);
+    }
+    stats->idle_waits = idle_waits;
+    stats->frame_start_ns = now;
+    stats->update_end_ns = now;
+}
+
+void frame_stats_end_update(Frame_Stats *stats) {
+    u64 now = platform_get_time_ns();
+    frame_stats_add(stats, Frame_Stats_Metric_Update, now - stats->frame_start_ns);
+    stats->update_end_ns = now;
+}
+
+void frame_stats_end_render(Frame_Stats *stats) {
+    u64 now = platform_get_time_ns();
+    frame_stats_add(stats, Frame_Stats_Metric_Render, now - stats->update_end_ns);
+
+    if (stats->log_interval_ms && now - stats->last_log_ns >= (u64)stats->log_interval_ms * 1000000) {
+        frame_stats_log(stats);
+        stats->last_log_ns = now;
+    }
+}
+
+Frame_Stats_Summary frame_stats_get_summary(Frame_Stats *stats, Frame_Stats_Metric metric) {
+    Frame_Stats_Window *window = &stats->windows[metric];
+    Frame_Stats_Summary summary = {0};
+    summary.count = window->count;
+    if (!window->count) return summary;
+
+    u32 max = 0;
+    for (u32 i = 0; i < window->count; ++i) {
+        max = Max(max, window->samples[i]);
+    }
+    summary.max_ms  = (f64)max / 1000.0;
+    summary.mean_ms = (f64)window->sum / (f64)window->count / 1000.0;
+
+    // The sample at rank ceil(p * count) decides each percentile.
+    u32 ranks[3];
+    f64 *results[3] = {&summary.p50_ms, &summary.p95_ms, &summary.p99_ms};
+    f64 percents[3] = {0.50, 0.95, 0.99};
+    for (u32 i = 0; i < 3; ++i) {
+        ranks[i] = (u32)((f64)window->count * percents[i] + 0.999999);
+        if (ranks[i] == 0) ranks[i] = 1;
+    }
+
+    u32 seen = 0;
+    u32 next = 0;
+    for (u32 bucket = 0; bucket < FRAME_STATS_BUCKETS && next < 3; ++bucket) {
+        seen += window->histogram[bucket];
+        while (next < 3 && seen >= ranks[next]) {
+            *results[next] = Min(frame_stats_us_from_bucket(bucket), (f64)max) / 1000.0;
+            next += 1;
+        }
+    }
+    return summary;
+}
+
+// The newest sample, 0 if there is none yet.
+u32 frame_stats_get_last_us(Frame_Stats *stats, Frame_Stats_Metric metric) {
+    Frame_Stats_Window *window = &stats->windows[metric];
+    if (!window->count) return 0;
+    return window->samples[(window->next + FRAME_STATS_WINDOW - 1) % FRAME_STATS_WINDOW];
+}
+
+// Frames in the window that went over the current budget.
+u32 frame_stats_get_window_hitches(Frame_Stats *stats) {
+    Frame_Stats_Window *window = &stats->windows[Frame_Stats_Metric_Frame];
+    f64 budget_us = frame_stats_get_budget(stats) * 1000.0;
+    u32 hitches = 0;
+    for (u32 i = 0; i < window->count; ++i) {
+        hitches += (f64)window->samples[i] > budget_us;
+    }
+    return hitches;
+}
+
+
+// =========================
+// >> Output
+
+void frame_stats_log(Frame_Stats *stats) {
+    Frame_Stats_Summary frame  = frame_stats_get_summary(stats, Frame_Stats_Metric_Frame);
+    Frame_Stats_Summary update = frame_stats_get_summary(stats, Frame_Stats_Metric_Update);
+    Frame_Stats_Summary render = frame_stats_get_summary(stats, Frame_Stats_Metric_Render);
+    LogInfo("frame p50 %.2f p95 %.2f p99 %.2f max %.2f ms | update p50 %.2f p99 %.2f | render p50 %.2f p99 %.2f | hitches %u/%u over %.2f ms, %llu total, %llu missed\n",
+            frame.p50_ms, frame.p95_ms, frame.p99_ms, frame.max_ms,
+            update.p50_ms, update.p99_ms, render.p50_ms, render.p99_ms,
+            frame_stats_get_window_hitches(stats), frame.count, frame_stats_get_budget(stats),
+            stats->hitches, stats->missed_frames);
+}
+
+// Builds a box in the top left corner with one line per time. Call it
+// between ui_begin and ui_end, after the rest of the UI.
+void frame_stats_overlay(Frame_Stats *stats) {
+    UI_Box *panel = ui_box_make(UI_Box_Flag_Floating_X | UI_Box_Flag_Floating_Y | UI_Box_Flag_Draw_Background, Str("frame_stats_overlay"));
+    panel->child_layout_axis = UI_Axis_Y;
+    panel->size[UI_Axis_X]   = ui_children_sum_size();
+    panel->size[UI_Axis_Y]   = ui_children_sum_size();
+    panel->fixed_pos         = vec2(8.0f, 8.0f);
+    panel->style.background  = vec4(0.1f, 0.1f, 0.1f, 1.0f);
+
+    Mem_Arena *arena = ui_frame_arena();
+    String lines[Frame_Stats_Metric_Count + 1];
+    for (u32 i = 0; i < Frame_Stats_Metric_Count; ++i) {
+        Frame_Stats_Summary summary = frame_stats_get_summary(stats, (Frame_Stats_Metric)i);
+        lines[i] = str_pushf(arena, "%-6s p50 %6.2f p95 %6.2f p99 %6.2f max %6.2f",
+                             frame_stats_metric_names[i], summary.p50_ms, summary.p95_ms, summary.p99_ms, summary.max_ms);
+    }
+    lines[Frame_Stats_Metric_Count] = str_pushf(arena, "hitches %u/%u over %.2f ms",
+                                                frame_stats_get_window_hitches(stats),
+                                                stats->windows[Frame_Stats_Metric_Frame].count,
+                                                frame_stats_get_budget(stats));
+
+    ui_push_parent(panel);
+    for (u32 i = 0; i < ArrayCount(lines); ++i) {
+        UI_Box *line = ui_box_make(UI_Box_Flag_Draw_Text, lines[i]);
+        line->size[UI_Axis_X] = ui_text_content_size(8.0f);
+        line->size[UI_Axis_Y] = ui_text_content_size(4.0f);
+        line->style.text      = vec4(1.0f, 1.0f, 1.0f, 1.0f);
+    }
+    ui_pop_parent();
+}
+
+#endif
+
+#endif
@@ -0,0 +1,565 @@
+/* jobs.h - v0.1 - Sven A. Schreiber
+ *
+ * jobs.h is a single header file library for running work in parallel
+ * on a fixed set of worker threads. It is part of and depends on my C
+ * base-layer.
+ *
+ * Every worker owns a Chase-Lev deque: it pushes and pops jobs at the
+ * bottom, idle workers steal from the top of the others. Jobs report
+ * to an optional Job_Counter, job_wait on that counter keeps running
+ * jobs until it reaches zero, which is all that is needed for fork/join.
+ * The thread that calls job_system_init becomes worker 0.
+ *
+ * To use this file simply define JOBS_IMPL once at the start of
+ * your project before including it. After that you can include it
+ * without defining JOBS_IMPL as per usual.
+ *
+ * Example:
+ * ...
+ * #define JOBS_IMPL
+ * #include "jobs.h"
+ * ...
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+// +============+
+// | DEFINTIONS |
+// +============+
+
+#define JOB_MAX_WORKERS 64
+#define JOB_DEQUE_CAPACITY 4096 // Must be a power of two.
+#define JOB_SCRATCH_SIZE MB(256)
+#define JOB_SPIN_COUNT 256
+#define JOB_LINE_INDEX_CHUNK_SIZE MB(1)
+
+typedef void Job_Proc(void *data);
+typedef void Job_Range_Proc(void *data, u64 begin, u64 end);
+
+// Number of jobs that have not finished yet. Zero-initialize it.
+typedef struct Job_Counter Job_Counter;
+struct Job_Counter {
+    volatile u32 value;
+    volatile u32 waiters;
+};
+
+typedef struct Job Job;
+struct Job {
+    Job_Proc *proc;
+    void *data;
+    Job_Counter *counter;
+};
+
+// top and bottom are kept on separate cache lines, thieves hammer top
+// while the owner works on bottom.
+typedef struct Job_Deque Job_Deque;
+struct Job_Deque {
+    volatile u64 top;
+    u8 pad0[56];
+    volatile u64 bottom;
+    u8 pad1[56];
+    Job jobs[JOB_DEQUE_CAPACITY];
+};
+
+typedef struct Job_Worker Job_Worker;
+struct Job_Worker {
+    Job_Deque deque;
+    Mem_Arena scratch;
+    Platform_Thread thread;
+    u32 index;
+    u32 random_state;
+    volatile u64 executed; // Only written by the worker itself.
+};
+
+typedef struct Job_System Job_System;
+struct Job_System {
+    Mem_Arena arena;
+    Job_Worker *workers;
+    u32 num_workers;
+    volatile u32 running;
+    volatile u32 signal; // Bumped whenever sleeping workers should look for jobs.
+    volatile u32 sleepers;
+
+    // Jobs submitted from threads that are not workers.
+    Platform_Mutex injected_mutex;
+    Job *injected;
+    u64 injected_first;
+    u64 injected_count;
+
+    volatile u64 executed_outside; // Jobs run by threads that are not workers.
+};
+
+// A snapshot for monitoring, taken without locks. The counts of
+// different workers are read at slightly different times.
+typedef struct Job_Stats Job_Stats;
+struct Job_Stats {
+    u32 workers;
+    u32 sleeping;
+    u64 queued;
+    u64 executed;
+};
+
+
+// +===========+
+// | INTERFACE |
+// +===========+
+
+void job_system_init(u32 num_workers);
+void job_system_shutdown();
+u32 job_get_worker_count();
+u32 job_get_worker_index();
+Mem_Arena *job_get_scratch();
+Job_Stats job_get_stats();
+
+void job_run(Job *jobs, u32 count, Job_Counter *counter);
+void job_wait(Job_Counter *counter);
+b32 job_counter_is_done(Job_Counter *counter);
+b32 job_run_one();
+void job_parallel_for(u64 count, u64 batch_size, Job_Range_Proc *proc, void *data);
+
+String_Line_Index str_line_index_make_parallel(Mem_Arena *arena, String text);
+
+
+// +===============+
+// | HELPER MACROS |
+// +===============+
+
+#define JOB_NOT_A_WORKER 0xFFFFFFFF
+
+
+// +================+
+// | IMPLEMENTATION |
+// +================+
+
+#ifdef JOBS_IMPL
+
+static Job_System job_system;
+static ThreadLocal Job_Worker *job_current_worker;
+
+// =========================
+// >> Deque
+//
+// Le, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing
+// for Weak Memory Models", with a fixed ring instead of a growing one.
+// Only the owner calls push and pop. The indices only ever grow, they
+// are compared as signed so that bottom may briefly drop below top.
+
+static b32 job_deque_push(Job_Deque *deque, Job job) {
+    u64 bottom = atomic_load_u64(&deque->bottom);
+    u64 top = atomic_load_u64(&deque->top);
+    if ((s64)(bottom - top) >= JOB_DEQUE_CAPACITY) return 0;
+    deque->jobs[bottom & (JOB_DEQUE_CAPACITY - 1)] = job;
+    atomic_store_u64(&deque->bottom, bottom + 1);
+    return 1;
+}
+
+static b32 job_deque_pop(Job_Deque *deque, Job *job) {
+    u64 bottom = atomic_load_u64(&deque->bottom) - 1;
+    atomic_store_u64(&deque->bottom, bottom);
+    u64 top = atomic_load_u64(&deque->top);
+
+    b32 result = 0;
+    if ((s64)(bottom - top) >= 0) {
+        *job = deque->jobs[bottom & (JOB_DEQUE_CAPACITY - 1)];
+        result = 1;
+        if (bottom == top) {
+            // Last job, race the thieves for it.
+            result = atomic_compare_exchange_u64(&deque->top, top, top + 1) == top;
+            atomic_store_u64(&deque->bottom, bottom + 1);
+        }
+    } else {
+        atomic_store_u64(&deque->bottom, bottom + 1);
+    }
+    return result;
+}
+
+static b32 job_deque_steal(Job_Deque *deque, Job *job) {
+    u64 top = atomic_load_u64(&deque->top);
+    u64 bottom = atomic_load_u64(&deque->bottom);
+    if ((s64)(bottom - top) <= 0) return 0;
+
+    // The slot can only be reused after top moved past it, in which case
+    // the exchange fails and the copy is thrown away.
+    Job result = deque->jobs[top & (JOB_DEQUE_CAPACITY - 1)];
+    if (atomic_compare_exchange_u64(&deque->top, top, top + 1) != top) return 0;
+    *job = result;
+    return 1;
+}
+
+
+// =========================
+// >> Scheduling
+
+static b32 job_injected_push(Job job) {
+    b32 result = 0;
+    platform_mutex_lock(&job_system.injected_mutex);
+    if (job_system.injected_count < JOB_DEQUE_CAPACITY) {
+        u64 index = (job_system.injected_first + job_system.injected_count) & (JOB_DEQUE_CAPACITY - 1);
+        job_system.injected[index] = job;
+        job_system.injected_count += 1;
+        result = 1;
+    }
+    platform_mutex_unlock(&job_system.injected_mutex);
+    return result;
+}
+
+static b32 job_injected_pop(Job *job) {
+    if (!atomic_load_u64(&job_system.injected_count)) return 0;
+    b32 result = 0;
+    platform_mutex_lock(&job_system.injected_mutex);
+    if (job_system.injected_count) {
+        *job = job_system.injected[job_system.injected_first];
+        job_system.injected_first = (job_system.injected_first + 1) & (JOB_DEQUE_CAPACITY - 1);
+        job_system.injected_count -= 1;
+        result = 1;
+    }
+    platform_mutex_unlock(&job_system.injected_mutex);
+    return result;
+}
+
+static b32 job_try_get(Job_Worker *worker, Job *job) {
+    if (worker && job_deque_pop(&worker->deque, job)) return 1;
+    if (job_injected_pop(job)) return 1;
+
+    // Start at a random victim so that thieves spread out.
+    u32 start = 0;
+    if (worker) {
+        u32 x = worker->random_state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        worker->random_state = x;
+        start = x % job_system.num_workers;
+    }
+    for (u32 i = 0; i < job_system.num_workers; ++i) {
+        Job_Worker *victim = &job_system.workers[(start + i) % job_system.num_workers];
+        if (victim == worker) continue;
+        if (job_deque_steal(&victim->deque, job)) return 1;
+    }
+    return 0;
+}
+
+static void job_execute(Job *job) {
+    ProfileScope("job") {
+        job->proc(job->data);
+    }
+    if (job->counter) {
+        // The waiter may return as soon as the value hits zero, reading
+        // waiters afterwards can at worst cause a spurious wake.
+        if (atomic_fetch_add_u32(&job->counter->value, (u32)-1) == 1 &&
+            atomic_load_u32(&job->counter->waiters)) {
+            platform_futex_wake(&job->counter->value, 1);
+        }
+    }
+    Job_Worker *worker = job_current_worker;
+    if (worker) {
+        atomic_store_u64(&worker->executed, worker->executed + 1);
+    } else {
+        atomic_fetch_add_u64(&job_system.executed_outside, 1);
+    }
+}
+
+static void job_notify(u32 count) {
+    if (atomic_load_u32(&job_system.sleepers)) {
+        atomic_fetch_add_u32(&job_system.signal, 1);
+        platform_futex_wake(&job_system.signal, count > 1);
+    }
+}
+
+static void job_worker_proc(void *data) {
+    Job_Worker *worker = (Job_Worker *)data;
+    job_current_worker = worker;
+    ProfileThreadName("Job Worker");
+
+    u32 spins = 0;
+    while (atomic_load_u32(&job_system.running)) {
+        Job job;
+        if (job_try_get(worker, &job)) {
+            job_execute(&job);
+            spins = 0;
+            continue;
+        }
+        if (++spins < JOB_SPIN_COUNT) {
+            cpu_pause();
+            continue;
+        }
+
+        // Announce the sleep before the last look, job_notify checks
+        // sleepers after pushing, so one of the two sees the other.
+        u32 signal = atomic_load_u32(&job_system.signal);
+        atomic_fetch_add_u32(&job_system.sleepers, 1);
+        if (job_try_get(worker, &job)) {
+            atomic_fetch_add_u32(&job_system.sleepers, (u32)-1);
+            job_execute(&job);
+        } else {
+            if (atomic_load_u32(&job_system.running)) {
+                platform_futex_wait(&job_system.signal, signal);
+            }
+            atomic_fetch_add_u32(&job_system.sleepers, (u32)-1);
+        }
+        spins = 0;
+    }
+}
+
+// 0 workers: one per core.
+void job_system_init(u32 num_workers) {
+    u32 num_cores = platform_get_core_count();
+    if (num_workers == 0) num_workers = num_cores;
+    if (num_workers > JOB_MAX_WORKERS) num_workers = JOB_MAX_WORKERS;
+
+    job_system.arena = mem_arena_init_with_align(64, MB(64));
+    job_system.workers = PushDataZero(&job_system.arena, Job_Worker, num_workers);
+    job_system.injected = PushData(&job_system.arena, Job, JOB_DEQUE_CAPACITY);
+    job_system.num_workers = num_workers;
+    job_system.running = 1;
+
+    for (u32 i = 0; i < num_workers; ++i) {
+        Job_Worker *worker = &job_system.workers[i];
+        worker->index = i;
+        worker->random_state = 0x9E3779B9u * (i + 1);
+        worker->scratch = mem_arena_init(JOB_SCRATCH_SIZE);
+    }
+
+    job_current_worker = &job_system.workers[0];
+    for (u32 i = 1; i < num_workers; ++i) {
+        Job_Worker *worker = &job_system.workers[i];
+        char name[32];
+        snprintf(name, sizeof(name), "Job Worker %u", i);
+        worker->thread = platform_thread_create(job_worker_proc, worker, name);
+        if (num_workers <= num_cores) {
+            platform_thread_set_affinity(worker->thread, i);
+        }
+    }
+}
+
+// Jobs still queued when this is called are dropped.
+void job_system_shutdown() {
+    atomic_store_u32(&job_system.running, 0);
+    atomic_fetch_add_u32(&job_system.signal, 1);
+    platform_futex_wake(&job_system.signal, 1);
+    for (u32 i = 1; i < job_system.num_workers; ++i) {
+        platform_thread_join(job_system.workers[i].thread);
+    }
+    for (u32 i = 0; i < job_system.num_workers; ++i) {
+        mem_arena_release(&job_system.workers[i].scratch);
+    }
+    mem_arena_release(&job_system.arena);
+    job_current_worker = 0;
+    memset(&job_system, 0, sizeof(job_system));
+}
+
+u32 job_get_worker_count() {
+    return job_system.num_workers;
+}
+
+u32 job_get_worker_index() {
+    return job_current_worker ? job_current_worker->index : JOB_NOT_A_WORKER;
+}
+
+// The calling worker's scratch arena, 0 on threads that are not workers.
+// Jobs may push onto it freely but have to pop back to where they
+// started before returning, other jobs share it when run by the same
+// worker while it waits on a counter.
+Mem_Arena *job_get_scratch() {
+    return job_current_worker ? &job_current_worker->scratch : 0;
+}
+
+Job_Stats job_get_stats() {
+    Job_Stats stats = {0};
+    stats.workers  = job_system.num_workers;
+    stats.sleeping = atomic_load_u32(&job_system.sleepers);
+    stats.queued   = atomic_load_u64(&job_system.injected_count);
+    stats.executed = atomic_load_u64(&job_system.executed_outside);
+    for (u32 i = 0; i < job_system.num_workers; ++i) {
+        Job_Worker *worker = &job_system.workers[i];
+        s64 size = (s64)(atomic_load_u64(&worker->deque.bottom) - atomic_load_u64(&worker->deque.top));
+        if (size > 0) stats.queued += (u64)size;
+        stats.executed += atomic_load_u64(&worker->executed);
+    }
+    return stats;
+}
+
+// Jobs that do not fit into the queue run immediately on the caller.
+void job_run(Job *jobs, u32 count, Job_Counter *counter) {
+    if (counter) atomic_fetch_add_u32(&counter->value, count);
+
+    Job_Worker *worker = job_current_worker;
+    for (u32 i = 0; i < count; ++i) {
+        Job job = jobs[i];
+        job.counter = counter;
+        b32 queued = worker ? job_deque_push(&worker->deque, job) : job_injected_push(job);
+        if (!queued) job_execute(&job);
+    }
+    job_notify(count);
+}
+
+// Runs other jobs until the counter reaches zero, and only sleeps when
+// there is nothing left to take.
+void job_wait(Job_Counter *counter) {
+    Job_Worker *worker = job_current_worker;
+    u32 spins = 0;
+    while (atomic_load_u32(&counter->value)) {
+        Job job;
+        if (job_try_get(worker, &job)) {
+            job_execute(&job);
+            spins = 0;
+            continue;
+        }
+        if (++spins < JOB_SPIN_COUNT) {
+            cpu_pause();
+            continue;
+        }
+
+        atomic_fetch_add_u32(&counter->waiters, 1);
+        u32 value = atomic_load_u32(&counter->value);
+        if (value) platform_futex_wait(&counter->value, value);
+        atomic_fetch_add_u32(&counter->waiters, (u32)-1);
+        spins = 0;
+    }
+}
+
+b32 job_counter_is_done(Job_Counter *counter) {
+    return atomic_load_u32(&counter->value) == 0;
+}
+
+// Runs a single queued job on the calling thread, if there is one.
+b32 job_run_one() {
+    Job job;
+    if (!job_system.num_workers || !job_try_get(job_current_worker, &job)) return 0;
+    job_execute(&job);
+    return 1;
+}
+
+
+// =========================
+// >> Parallel for
+
+typedef struct Job_Range Job_Range;
+struct Job_Range {
+    Job_Range_Proc *proc;
+    void *data;
+    u64 begin;
+    u64 end;
+};
+
+static void job_range_proc(void *data) {
+    Job_Range *range = (Job_Range *)data;
+    range->proc(range->data, range->begin, range->end);
+}
+
+// Calls proc on batches of [0, count) in parallel and returns once all
+// of them are done. A batch_size of 0 picks one that gives every worker
+// a few batches to balance the load. On threads that are not workers
+// the whole range runs on the caller.
+void job_parallel_for(u64 count, u64 batch_size, Job_Range_Proc *proc, void *data) {
+    if (count == 0) return;
+    Job_Worker *worker = job_current_worker;
+    if (batch_size == 0) {
+        batch_size = count / (job_system.num_workers * 4);
+        if (batch_size == 0) batch_size = 1;
+    }
+    u64 num_batches = (count + batch_size - 1) / batch_size;
+    if (!worker || job_system.num_workers == 1 || num_batches == 1) {
+        proc(data, 0, count);
+        return;
+    }
+
+    Mem_Arena *scratch = &worker->scratch;
+    u64 scratch_pos = scratch->alloc_pos;
+    Job_Range *ranges = PushData(scratch, Job_Range, num_batches);
+    Job *jobs = PushData(scratch, Job, num_batches);
+    for (u64 i = 0; i < num_batches; ++i) {
+        ranges[i].proc  = proc;
+        ranges[i].data  = data;
+        ranges[i].begin = i * batch_size;
+        ranges[i].end   = Min(count, ranges[i].begin + batch_size);
+        jobs[i].proc = job_range_proc;
+        jobs[i].data = &ranges[i];
+    }
+
+    Job_Counter counter = {0};
+    for (u64 i = 0; i < num_batches; i += JOB_DEQUE_CAPACITY) {
+        u64 batches = Min(num_batches - i, JOB_DEQUE_CAPACITY);
+        job_run(jobs + i, (u32)batches, &counter);
+    }
+    job_wait(&counter);
+    mem_arena_pop(scratch, scratch->alloc_pos - scratch_pos);
+}
+
+
+// =========================
+// >> Parallel line index
+//
+// Same result as str_line_index_make. The text is cut into chunks, the
+// first pass counts the newlines per chunk, a prefix sum over the counts
+// tells every chunk where its offsets go, and the second pass fills them.
+
+typedef struct Job_Line_Index Job_Line_Index;
+struct Job_Line_Index {
+    String text;
+    u64 *chunk_lines;
+    u64 *offsets;
+};
+
+static String job_line_index_chunk(String text, u64 chunk) {
+    u64 begin = chunk * JOB_LINE_INDEX_CHUNK_SIZE;
+    u64 end = Min(text.size, begin + JOB_LINE_INDEX_CHUNK_SIZE);
+    return str_substring(text, begin, end);
+}
+
+static void job_line_index_count(void *data, u64 begin, u64 end) {
+    Job_Line_Index *index = (Job_Line_Index *)data;
+    for (u64 i = begin; i < end; ++i) {
+        index->chunk_lines[i] = str_count_newlines(job_line_index_chunk(index->text, i));
+    }
+}
+
+static void job_line_index_fill(void *data, u64 begin, u64 end) {
+    Job_Line_Index *index = (Job_Line_Index *)data;
+    for (u64 i = begin; i < end; ++i) {
+        String chunk = job_line_index_chunk(index->text, i);
+        str_find_line_starts(chunk, i * JOB_LINE_INDEX_CHUNK_SIZE, index->offsets + 1 + index->chunk_lines[i]);
+    }
+}
+
+String_Line_Index str_line_index_make_parallel(Mem_Arena *arena, String text) {
+    Job_Worker *worker = job_current_worker;
+    if (!worker || job_system.num_workers == 1 || text.size < 2 * JOB_LINE_INDEX_CHUNK_SIZE) {
+        return str_line_index_make(arena, text);
+    }
+
+    Mem_Arena *scratch = &worker->scratch;
+    u64 scratch_pos = scratch->alloc_pos;
+    u64 num_chunks = (text.size + JOB_LINE_INDEX_CHUNK_SIZE - 1) / JOB_LINE_INDEX_CHUNK_SIZE;
+
+    Job_Line_Index index = {0};
+    index.text = text;
+    index.chunk_lines = PushData(scratch, u64, num_chunks);
+    job_parallel_for(num_chunks, 1, job_line_index_count, &index);
+
+    u64 newlines = 0;
+    for (u64 i = 0; i < num_chunks; ++i) {
+        u64 lines = index.chunk_lines[i];
+        index.chunk_lines[i] = newlines;
+        newlines += lines;
+    }
+
+    String_Line_Index result = {0};
+    result.text = text;
+    b32 ends_with_newline = text.str[text.size - 1] == '\n';
+    result.num_lines = newlines + !ends_with_newline;
+    result.offsets = PushData(arena, u64, result.num_lines + 1);
+    result.offsets[0] = 0;
+
+    index.offsets = result.offsets;
+    job_parallel_for(num_chunks, 1, job_line_index_fill, &index);
+    result.offsets[result.num_lines] = text.size;
+
+    mem_arena_pop(scratch, scratch->alloc_pos - scratch_pos);
+    return result;
+}
+
+#endif
+
+#endif
@@ -1,12 +1,17 @@
 #ifndef KEY_INPUT_H
 #define KEY_INPUT_H
 
+// The backends translate OS key codes with a table per platform, filled
+// from the columns of key_list.inc. Codes without an entry translate to
+// KEY_UNKNOWN and are not passed on as key events.
+
 typedef s32 Key;
 enum Key {
-#define Key(name, str) KEY_##name,
+#define Key(name, str, win32, mac, x11) KEY_##name,
 #include "key_list.inc"
 #undef Key
-    KEY_MAX
+    KEY_MAX,
+    KEY_UNKNOWN = KEY_MAX
 };
 
 typedef s32 Key_Modifiers;
@@ -16,9 +21,26 @@ enum Key_Modifiers {
     KEY_MODIFIER_ALT   = (1<<2)
 };
 
+// The bit a modifier key sets while it is held, 0 for other keys.
+Key_Modifiers key_get_modifier(Key key) {
+    switch (key) {
+        case KEY_CTRL:  return KEY_MODIFIER_CTRL;
+        case KEY_SHIFT: return KEY_MODIFIER_SHIFT;
+        case KEY_ALT:   return KEY_MODIFIER_ALT;
+    }
+    return 0;
+}
+
+// The modifiers that go with an event of key, from all held modifiers.
+// A modifier key leaves out its own bit, so that Ctrl on its own is not
+// Ctrl+Ctrl, no matter whether the OS counts the key as held yet.
+Key_Modifiers key_event_modifiers(Key key, Key_Modifiers held) {
+    return held & ~key_get_modifier(key);
+}
+
 String get_key_name(s32 index) {
     static char *strings[KEY_MAX] = {
-#define Key(name, str) str,
+#define Key(name, str, win32, mac, x11) str,
 #include "key_list.inc"
 #undef Key
     };
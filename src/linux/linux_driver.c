@@ -0,0 +1,340 @@
+// Frame driver shared by the offscreen Linux backends. It runs app_init
+// and then app_update for a fixed number of frames with a fixed delta,
+// pushes scripted events before the frames they belong to and prints how
+// long app_init and app_update took.
+//
+// Usage:
+//   app [--frames N] [--warmup N] [--delta-ms D] [--size WxH] [--script FILE]
+//       [backend options]
+//
+// Script, one entry per line, # starts a comment. Frames count from 0
+// and must not go down from one line to the next:
+//   <frame> key_press <key>       keys by their name in key_list.inc
+//   <frame> key_release <key>
+//   <frame> char <c>              a single character or a codepoint
+//   <frame> mouse_press <key>     mouse_button_left, mouse_button_right
+//   <frame> mouse_release <key>
+//   <frame> mouse_move <x> <y>
+//   <frame> scroll <delta>
+//   <frame> resize <width> <height>
+//   <frame> quit
+
+#define LINUX_DEFAULT_FRAMES 600
+
+typedef enum Linux_Command Linux_Command;
+enum Linux_Command {
+    Linux_Command_Event,
+    Linux_Command_Resize,
+    Linux_Command_Quit
+};
+
+typedef struct Linux_Script_Entry Linux_Script_Entry;
+struct Linux_Script_Entry {
+    u64 frame;
+    Linux_Command command;
+    Platform_Event event;
+    s32 width;
+    s32 height;
+};
+
+typedef struct Linux_Script Linux_Script;
+struct Linux_Script {
+    Linux_Script_Entry *entries;
+    u64 count;
+    u64 next;
+};
+
+static Platform_State global_platform_state;
+
+// Implemented by the backend that includes this file. The option hook
+// returns how many arguments it used, 0 if it does not know the option.
+static s32 linux_backend_option(char *name, char *value);
+static b32 linux_backend_init(s32 width, s32 height);
+static void linux_backend_resize(s32 width, s32 height);
+static void linux_backend_shutdown();
+
+static b32 linux_name_equal(String a, char *b) {
+    u64 size = strlen(b);
+    if (a.size != size) return 0;
+    for (u64 i = 0; i < size; ++i) {
+        u8 x = a.str[i];
+        u8 y = (u8)b[i];
+        if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+        if (x != y) return 0;
+    }
+    return 1;
+}
+
+static b32 linux_key_from_name(String name, Key *key) {
+    for (s32 i = 0; i < KEY_MAX; ++i) {
+        if (linux_name_equal(name, (char *)get_key_name(i).str)) {
+            *key = (Key)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static b32 linux_parse_s64(String string, s64 *value) {
+    u64 consumed = 0;
+    return str_to_s64(string, value, &consumed) && consumed == string.size;
+}
+
+static b32 linux_parse_entry(Mem_Arena *arena, String line, Linux_Script_Entry *entry) {
+    String words[4];
+    u32 count = 0;
+    String_List parts = str_split(arena, line, Str(" "));
+    for (String_List_Node *node = parts.first; node; node = node->next) {
+        if (node->string.size == 0) continue;
+        if (count == ArrayCount(words)) return 0;
+        words[count++] = node->string;
+    }
+    if (count < 2) return 0;
+
+    s64 frame, x, y;
+    if (!linux_parse_s64(words[0], &frame) || frame < 0) return 0;
+    memset(entry, 0, sizeof(*entry));
+    entry->frame = (u64)frame;
+    entry->command = Linux_Command_Event;
+    Platform_Event *event = &entry->event;
+    String name = words[1];
+
+    if (linux_name_equal(name, "key_press") || linux_name_equal(name, "mouse_press")) {
+        event->type = linux_name_equal(name, "key_press") ? Platform_Event_Type_Key_Press : Platform_Event_Type_Mouse_Press;
+        return count == 3 && linux_key_from_name(words[2], &event->key);
+    }
+    if (linux_name_equal(name, "key_release") || linux_name_equal(name, "mouse_release")) {
+        event->type = linux_name_equal(name, "key_release") ? Platform_Event_Type_Key_Release : Platform_Event_Type_Mouse_Release;
+        return count == 3 && linux_key_from_name(words[2], &event->key);
+    }
+    if (linux_name_equal(name, "char") && count == 3) {
+        event->type = Platform_Event_Type_Character_Input;
+        if (words[2].size == 1) {
+            event->character = words[2].str[0];
+            return 1;
+        }
+        if (!linux_parse_s64(words[2], &x) || x < 0) return 0;
+        event->character = (u32)x;
+        return 1;
+    }
+    if (linux_name_equal(name, "mouse_move") && count == 4) {
+        event->type = Platform_Event_Type_Mouse_Move;
+        if (!linux_parse_s64(words[2], &x) || !linux_parse_s64(words[3], &y)) return 0;
+        event->mouse_pos = ivec2((s32)x, (s32)y);
+        return 1;
+    }
+    if (linux_name_equal(name, "scroll") && count == 3) {
+        event->type = Platform_Event_Type_Mouse_Scroll;
+        if (!linux_parse_s64(words[2], &x)) return 0;
+        event->scroll_delta = (s32)x;
+        return 1;
+    }
+    if (linux_name_equal(name, "resize") && count == 4) {
+        entry->command = Linux_Command_Resize;
+        if (!linux_parse_s64(words[2], &x) || !linux_parse_s64(words[3], &y) || x <= 0 || y <= 0) return 0;
+        entry->width  = (s32)x;
+        entry->height = (s32)y;
+        return 1;
+    }
+    if (linux_name_equal(name, "quit") && count == 2) {
+        entry->command = Linux_Command_Quit;
+        return 1;
+    }
+    return 0;
+}
+
+static b32 linux_load_script(Mem_Arena *arena, char *file_name, Linux_Script *script) {
+    String mapped;
+    if (!platform_map_file(file_name, Platform_Map_Flag_Sequential, &mapped)) {
+        platform_log("Could not open the script '%s'.\n", file_name);
+        return 0;
+    }
+    // The mapping is read-only and lines are edited in place below.
+    String data = str_copy(arena, mapped);
+    platform_unmap_file(mapped);
+
+    u64 lines = str_count_newlines(data) + 1;
+    script->entries = PushData(arena, Linux_Script_Entry, lines);
+    script->count = 0;
+    script->next = 0;
+
+    b32 ok = 1;
+    u64 line_number = 0;
+    String_Line_Iter iter = str_line_iter(data);
+    String line;
+    while (ok && str_line_iter_next(&iter, &line)) {
+        line_number += 1;
+        for (u64 i = 0; i < line.size; ++i) {
+            if (line.str[i] == '#' || line.str[i] == '\r') {
+                line.size = i;
+                break;
+            }
+        }
+        for (u64 i = 0; i < line.size; ++i) {
+            if (line.str[i] == '\t') line.str[i] = ' ';
+        }
+        b32 blank = 1;
+        for (u64 i = 0; i < line.size; ++i) blank &= line.str[i] == ' ';
+        if (blank) continue;
+
+        Linux_Script_Entry *entry = &script->entries[script->count];
+        if (!linux_parse_entry(arena, line, entry)) {
+            platform_log("%s:%llu: cannot read '%.*s'.\n", file_name, line_number, (int)line.size, line.str);
+            ok = 0;
+        } else if (script->count && entry->frame < script->entries[script->count - 1].frame) {
+            platform_log("%s:%llu: frame %llu comes after frame %llu.\n", file_name, line_number,
+                         entry->frame, script->entries[script->count - 1].frame);
+            ok = 0;
+        } else {
+            script->count += 1;
+        }
+    }
+    return ok;
+}
+
+static void linux_run_script(Linux_Script *script, u64 frame) {
+    while (script->next < script->count && script->entries[script->next].frame == frame) {
+        Linux_Script_Entry *entry = &script->entries[script->next++];
+        switch (entry->command) {
+            case Linux_Command_Event: {
+                platform_push_event(entry->event);
+            } break;
+
+            case Linux_Command_Resize: {
+                platform_state->window_width  = entry->width;
+                platform_state->window_height = entry->height;
+            } break;
+
+            case Linux_Command_Quit: {
+                atomic_store_u32(&platform_state->running, 0);
+            } break;
+        }
+    }
+}
+
+static int linux_compare_u64(const void *a, const void *b) {
+    u64 x = *(const u64 *)a;
+    u64 y = *(const u64 *)b;
+    return (x > y) - (x < y);
+}
+
+static f64 linux_percentile_ms(u64 *sorted, u64 count, f64 percent) {
+    u64 rank = (u64)((f64)count * percent + 0.999999);
+    if (rank == 0) rank = 1;
+    if (rank > count) rank = count;
+    return (f64)sorted[rank - 1] / 1000000.0;
+}
+
+static void linux_usage(char *program) {
+    fprintf(stderr, "Usage: %s [--frames N] [--warmup N] [--delta-ms D] [--size WxH] [--script FILE] [backend options]\n", program);
+}
+
+int main(int argc, char **argv) {
+    u64 frames = LINUX_DEFAULT_FRAMES;
+    u64 warmup = 0;
+    f64 delta_ms = 1000.0 / 60.0;
+    s32 width  = PLATFORM_DEFAULT_WINDOW_WIDTH;
+    s32 height = PLATFORM_DEFAULT_WINDOW_HEIGHT;
+    char *script_file = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        char *arg = argv[i];
+        char *value = i + 1 < argc ? argv[i + 1] : 0;
+        s32 used = linux_backend_option(arg, value);
+        if (used) {
+            i += used - 1;
+            continue;
+        }
+        if (!value) {
+            linux_usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(arg, "--frames") == 0) {
+            frames = strtoull(value, 0, 10);
+        } else if (strcmp(arg, "--warmup") == 0) {
+            warmup = strtoull(value, 0, 10);
+        } else if (strcmp(arg, "--delta-ms") == 0) {
+            delta_ms = strtod(value, 0);
+        } else if (strcmp(arg, "--size") == 0) {
+            if (sscanf(value, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                linux_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(arg, "--script") == 0) {
+            script_file = value;
+        } else {
+            linux_usage(argv[0]);
+            return 1;
+        }
+        i += 1;
+    }
+
+    platform_state = &global_platform_state;
+    {
+        platform_state->window_width  = width;
+        platform_state->window_height = height;
+        platform_state->running       = 1;
+    }
+    platform_event_queue_init(&platform_state->events);
+
+    Mem_Arena arena = mem_arena_init(GB(4));
+    Linux_Script script = {0};
+    if (script_file && !linux_load_script(&arena, script_file, &script)) {
+        return 1;
+    }
+    u64 *times = PushDataZero(&arena, u64, frames + 1);
+
+    if (!linux_backend_init(width, height)) {
+        return 1;
+    }
+    u64 init_start = platform_get_time_ns();
+    app_init();
+    u64 init_end = platform_get_time_ns();
+
+    u64 delta_ns = (u64)(delta_ms * 1000000.0);
+    u64 time_ns = platform_get_time_ns();
+    u64 measured = 0;
+    u64 frame = 0;
+    u64 run_start = platform_get_time_ns();
+    for (; frame < frames && atomic_load_u32(&platform_state->running); ++frame) {
+        linux_run_script(&script, frame);
+        if (!atomic_load_u32(&platform_state->running)) break;
+        if (platform_state->window_width != width || platform_state->window_height != height) {
+            width  = platform_state->window_width;
+            height = platform_state->window_height;
+            linux_backend_resize(width, height);
+        }
+
+        time_ns += delta_ns;
+        platform_state->time_ns  = time_ns;
+        platform_state->delta_ns = delta_ns;
+        platform_state->delta    = (f32)(delta_ms / 1000.0);
+
+        u64 start = platform_get_time_ns();
+        app_update();
+        u64 end = platform_get_time_ns();
+        if (frame >= warmup) times[measured++] = end - start;
+    }
+    u64 run_end = platform_get_time_ns();
+
+    app_shutdown();
+    linux_backend_shutdown();
+
+    printf("frames %llu (warmup %llu), delta %.3f ms, window %dx%d\n",
+           (unsigned long long)frame, (unsigned long long)Min(warmup, frame), delta_ms, width, height);
+    if (measured) {
+        u64 total = 0;
+        for (u64 i = 0; i < measured; ++i) total += times[i];
+        qsort(times, measured, sizeof(*times), linux_compare_u64);
+        printf("app_update ms: mean %.4f p50 %.4f p95 %.4f p99 %.4f max %.4f total %.3f\n",
+               (f64)total / (f64)measured / 1000000.0,
+               linux_percentile_ms(times, measured, 0.50),
+               linux_percentile_ms(times, measured, 0.95),
+               linux_percentile_ms(times, measured, 0.99),
+               (f64)times[measured - 1] / 1000000.0,
+               (f64)total / 1000000.0);
+    }
+    printf("app_init %.3f ms, frames %.3f ms\n", (f64)(init_end - init_start) / 1000000.0, (f64)(run_end - run_start) / 1000000.0);
+    return 0;
+}
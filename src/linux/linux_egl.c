@@ -0,0 +1,198 @@
+// Offscreen Linux backend that runs the real GL code path. The context
+// comes from EGL without a window: on Mesa's surfaceless platform when
+// it is there, on the default display otherwise. That works with
+// llvmpipe, so no GPU is needed. The app draws into a framebuffer
+// object, and swapping waits until it is done, optionally reading the
+// pixels back.
+//
+// Backend options, see linux_driver.c for the rest:
+//   --readback      read the frame back with glReadPixels on every swap
+//   --dump FILE     write the last frame as a PPM image, implies --readback
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "linux_platform.c"
+
+typedef struct Linux_EGL_State Linux_EGL_State;
+struct Linux_EGL_State {
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface surface; // EGL_NO_SURFACE when the context can be surfaceless.
+    GLuint framebuffer;
+    GLuint color;
+    s32 width;
+    s32 height;
+
+    b32 readback;
+    char *dump_file;
+    u8 *pixels;
+};
+
+static Linux_EGL_State linux_egl;
+
+void *platform_get_gl_proc_address(char *function_name) {
+    return (void *)eglGetProcAddress(function_name);
+}
+
+void platform_swap_buffers() {
+    if (linux_egl.readback) {
+        glReadPixels(0, 0, linux_egl.width, linux_egl.height, GL_RGBA, GL_UNSIGNED_BYTE, linux_egl.pixels);
+    } else {
+        glFinish();
+    }
+}
+
+static EGLDisplay linux_egl_get_display() {
+    char *client_extensions = (char *)eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (linux_has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (eglGetPlatformDisplayEXT) {
+            EGLDisplay display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+            if (display != EGL_NO_DISPLAY) return display;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static b32 linux_egl_choose_config(EGLDisplay display, EGLConfig *config) {
+    EGLint attributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+        EGL_RED_SIZE,        8,
+        EGL_GREEN_SIZE,      8,
+        EGL_BLUE_SIZE,       8,
+        EGL_ALPHA_SIZE,      8,
+        EGL_NONE
+    };
+    EGLint count = 0;
+    if (eglChooseConfig(display, attributes, config, 1, &count) && count > 0) return 1;
+
+    // Rendering only goes to the framebuffer object, any surface type will do.
+    attributes[3] = EGL_DONT_CARE;
+    return eglChooseConfig(display, attributes, config, 1, &count) && count > 0;
+}
+
+static void linux_egl_resize_framebuffer(s32 width, s32 height) {
+    linux_egl.width  = width;
+    linux_egl.height = height;
+    glBindRenderbuffer(GL_RENDERBUFFER, linux_egl.color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    if (linux_egl.readback) {
+        free(linux_egl.pixels);
+        linux_egl.pixels = (u8 *)malloc((u64)width * (u64)height * 4);
+    }
+}
+
+static s32 linux_backend_option(char *name, char *value) {
+    if (strcmp(name, "--readback") == 0) {
+        linux_egl.readback = 1;
+        return 1;
+    }
+    if (strcmp(name, "--dump") == 0 && value) {
+        linux_egl.readback  = 1;
+        linux_egl.dump_file = value;
+        return 2;
+    }
+    return 0;
+}
+
+static b32 linux_backend_init(s32 width, s32 height) {
+    EGLint major, minor;
+    EGLConfig config;
+    linux_egl.display = linux_egl_get_display();
+    if (linux_egl.display == EGL_NO_DISPLAY || !eglInitialize(linux_egl.display, &major, &minor)) {
+        platform_log("EGL: no display could be initialized.\n");
+        return 0;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API) || !linux_egl_choose_config(linux_egl.display, &config)) {
+        platform_log("EGL: no config with desktop OpenGL.\n");
+        return 0;
+    }
+
+    // No attributes give a compatibility context, the app still uses the
+    // fixed function pipeline.
+    linux_egl.context = eglCreateContext(linux_egl.display, config, EGL_NO_CONTEXT, 0);
+    if (linux_egl.context == EGL_NO_CONTEXT) {
+        platform_log("EGL: the context could not be created (0x%x).\n", eglGetError());
+        return 0;
+    }
+
+    linux_egl.surface = EGL_NO_SURFACE;
+    char *extensions = (char *)eglQueryString(linux_egl.display, EGL_EXTENSIONS);
+    if (!linux_has_extension(extensions, "EGL_KHR_surfaceless_context")) {
+        EGLint pbuffer_attributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        linux_egl.surface = eglCreatePbufferSurface(linux_egl.display, config, pbuffer_attributes);
+        if (linux_egl.surface == EGL_NO_SURFACE) {
+            platform_log("EGL: the pbuffer could not be created (0x%x).\n", eglGetError());
+            return 0;
+        }
+    }
+    if (!eglMakeCurrent(linux_egl.display, linux_egl.surface, linux_egl.surface, linux_egl.context)) {
+        platform_log("EGL: the context could not be made current (0x%x).\n", eglGetError());
+        return 0;
+    }
+
+    glGenFramebuffers(1, &linux_egl.framebuffer);
+    glGenRenderbuffers(1, &linux_egl.color);
+    linux_egl_resize_framebuffer(width, height);
+    glBindFramebuffer(GL_FRAMEBUFFER, linux_egl.framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, linux_egl.color);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        platform_log("EGL: the framebuffer is incomplete.\n");
+        return 0;
+    }
+    glViewport(0, 0, width, height);
+
+    platform_log("EGL %d.%d, %s, %s\n", major, minor, glGetString(GL_VERSION), glGetString(GL_RENDERER));
+    return 1;
+}
+
+static void linux_backend_resize(s32 width, s32 height) {
+    linux_egl_resize_framebuffer(width, height);
+    glViewport(0, 0, width, height);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0.0f, (f32)width, (f32)height, 0.0f, 0.0f, 1.0f);
+}
+
+// PPM rows go from the top, GL rows from the bottom.
+static b32 linux_egl_write_ppm(char *file_name) {
+    FILE *file = fopen(file_name, "wb");
+    if (!file) return 0;
+
+    s32 width  = linux_egl.width;
+    s32 height = linux_egl.height;
+    u8 *row = (u8 *)malloc((u64)width * 3);
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (s32 y = height - 1; y >= 0; --y) {
+        u8 *source = linux_egl.pixels + (u64)y * (u64)width * 4;
+        for (s32 x = 0; x < width; ++x) {
+            row[x * 3 + 0] = source[x * 4 + 0];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+        fwrite(row, 1, (u64)width * 3, file);
+    }
+    free(row);
+    return fclose(file) == 0;
+}
+
+static void linux_backend_shutdown() {
+    if (linux_egl.dump_file && !linux_egl_write_ppm(linux_egl.dump_file)) {
+        platform_log("Could not write the frame to '%s'.\n", linux_egl.dump_file);
+    }
+    free(linux_egl.pixels);
+    linux_egl.pixels = 0;
+
+    glDeleteRenderbuffers(1, &linux_egl.color);
+    glDeleteFramebuffers(1, &linux_egl.framebuffer);
+    eglMakeCurrent(linux_egl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (linux_egl.surface != EGL_NO_SURFACE) eglDestroySurface(linux_egl.display, linux_egl.surface);
+    eglDestroyContext(linux_egl.display, linux_egl.context);
+    eglTerminate(linux_egl.display);
+}
+
+#include "linux_driver.c"
@@ -0,0 +1,35 @@
+// OpenGL without a GPU or a GL library: every function the app and ui.h
+// call does nothing. Calls that create objects hand out increasing
+// names, so code that checks for 0 behaves as it would with a driver.
+// A GL function used anywhere else has to be added here, the link
+// fails until it is.
+
+static GLuint linux_gl_stub_next_name = 1;
+
+void *platform_get_gl_proc_address(char *function_name) {
+    return 0;
+}
+
+void glGenTextures(GLsizei n, GLuint *textures) {
+    for (GLsizei i = 0; i < n; ++i) textures[i] = linux_gl_stub_next_name++;
+}
+
+void glActiveTexture(GLenum texture) {}
+void glBindTexture(GLenum target, GLuint texture) {}
+void glTexImage2D(GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels) {}
+void glTexParameteri(GLenum target, GLenum name, GLint param) {}
+void glEnable(GLenum cap) {}
+void glDisable(GLenum cap) {}
+void glBlendFunc(GLenum source, GLenum dest) {}
+void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {}
+void glClear(GLbitfield mask) {}
+void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {}
+void glMatrixMode(GLenum mode) {}
+void glLoadIdentity() {}
+void glOrtho(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near_val, GLdouble far_val) {}
+void glBegin(GLenum mode) {}
+void glEnd() {}
+void glVertex3f(GLfloat x, GLfloat y, GLfloat z) {}
+void glColor3f(GLfloat red, GLfloat green, GLfloat blue) {}
+void glTexCoord2f(GLfloat s, GLfloat t) {}
+void glFlush() {}
@@ -0,0 +1,25 @@
+// Headless Linux backend. There is no window, no display and no GPU, GL
+// calls go to the stubs in linux_gl_stub.c. It measures everything but
+// the GL driver, see linux_driver.c for the options.
+
+#include "linux_platform.c"
+#include "linux_gl_stub.c"
+
+void platform_swap_buffers() {
+}
+
+static s32 linux_backend_option(char *name, char *value) {
+    return 0;
+}
+
+static b32 linux_backend_init(s32 width, s32 height) {
+    return 1;
+}
+
+static void linux_backend_resize(s32 width, s32 height) {
+}
+
+static void linux_backend_shutdown() {
+}
+
+#include "linux_driver.c"
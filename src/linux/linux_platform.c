@@ -0,0 +1,64 @@
+// Platform functions shared by all Linux backends (headless, EGL, X11).
+// Each backend includes this file and adds its window, GL context and
+// main function.
+
+#include "../posix/posix_platform.c"
+
+void *platform_reserve_memory(u64 size) {
+    void *mem = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return mem == MAP_FAILED ? 0 : mem;
+}
+
+// Pages become backed by memory on first touch, committing only makes
+// them accessible.
+void platform_commit_memory(void *mem, u64 size) {
+    mprotect(mem, size, PROT_READ | PROT_WRITE);
+}
+
+void platform_release_memory(void *mem, u64 size) {
+    munmap(mem, size);
+}
+
+void platform_decommit_memory(void *mem, u64 size) {
+    madvise(mem, size, MADV_DONTNEED);
+    mprotect(mem, size, PROT_NONE);
+}
+
+// Logs go to stderr, which keeps stdout free for results.
+void platform_log(char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+b32 platform_read_entire_file(char *file_name, Platform_File *result) {
+    FILE *stream = fopen(file_name, "rb");
+    if (!stream) {
+        return 0;
+    }
+
+    fseek(stream, 0, SEEK_END);
+    result->size = ftell(stream);
+    fseek(stream, 0, SEEK_SET);
+
+    result->data = platform_reserve_memory(result->size);
+    platform_commit_memory(result->data, result->size);
+
+    b32 ok = fread(result->data, result->size, 1, stream) == 1 || result->size == 0;
+    fclose(stream);
+    return ok;
+}
+
+// Looks for a whole name in a space separated extension string, as EGL
+// and GLX return them.
+b32 linux_has_extension(char *extensions, char *name) {
+    if (!extensions) return 0;
+    u64 size = strlen(name);
+    for (char *at = strstr(extensions, name); at; at = strstr(at + size, name)) {
+        b32 starts = at == extensions || at[-1] == ' ';
+        b32 ends   = at[size] == 0 || at[size] == ' ';
+        if (starts && ends) return 1;
+    }
+    return 0;
+}
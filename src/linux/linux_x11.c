@@ -0,0 +1,525 @@
+// X11 backend with a GLX context. Input comes through XInput2.
+//
+// As on win32, the window and its events belong to a thread of their
+// own. It has a second connection to the server, since Xlib is not used
+// from two threads on one connection, and GLX renders on the main
+// thread's connection. The window is created on the event thread so
+// that the window manager's WM_DELETE_WINDOW reaches it.
+
+#include <locale.h>
+#include <poll.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XInput2.h>
+#include <GL/glx.h>
+
+#include "linux_platform.c"
+
+// One XI2 wheel click, the same units as WHEEL_DELTA on win32.
+#define X11_SCROLL_STEP 120
+
+typedef struct X11_Event_Thread X11_Event_Thread;
+struct X11_Event_Thread {
+    Display *display;
+    Window window;
+    VisualID visual_id;
+    s32 xi_opcode;
+    Atom wm_delete_window;
+    XIM input_method;
+    XIC input_context;
+    s32 wake_pipe[2]; // Written to by the main thread when it is done.
+    Platform_Thread_Event window_created;
+};
+
+static Platform_State global_platform_state;
+static Display       *global_gl_display;
+static Window         global_window;
+static GLXContext     global_gl_context;
+
+typedef GLXContext X11_Create_Context_Attribs(Display *display, GLXFBConfig config, GLXContext share, Bool direct, const int *attributes);
+typedef void X11_Swap_Interval_EXT(Display *display, GLXDrawable drawable, int interval);
+typedef int X11_Swap_Interval_MESA(unsigned int interval);
+
+void platform_swap_buffers() {
+    glXSwapBuffers(global_gl_display, global_window);
+}
+
+void *platform_get_gl_proc_address(char *function_name) {
+    return (void *)glXGetProcAddressARB((const GLubyte *)function_name);
+}
+
+// =========================
+// >> Input
+
+static Key_Modifiers x11_get_modifiers(u32 state) {
+    Key_Modifiers key_modifiers = 0;
+    if (state & ControlMask) key_modifiers |= KEY_MODIFIER_CTRL;
+    if (state & ShiftMask)   key_modifiers |= KEY_MODIFIER_SHIFT;
+    if (state & Mod1Mask)    key_modifiers |= KEY_MODIFIER_ALT;
+    return key_modifiers;
+}
+
+// Keycode -> Key. Keycodes are the server's, so the table is filled at
+// startup and after MappingNotify from the unshifted keysym of every
+// keycode, matched against the keysyms in key_list.inc.
+static Key x11_key_table[256];
+
+static Key x11_key_from_keysym(KeySym keysym) {
+    // key_list.inc only has the left one of each modifier.
+    if (keysym == XK_Shift_R)   keysym = XK_Shift_L;
+    if (keysym == XK_Control_R) keysym = XK_Control_L;
+    if (keysym == XK_Alt_R)     keysym = XK_Alt_L;
+#define Key(name, str, win32, mac, x11) if ((x11) != -1 && keysym == (KeySym)(x11)) return KEY_##name;
+#include "../key_list.inc"
+#undef Key
+    return KEY_UNKNOWN;
+}
+
+static void x11_init_key_table(Display *display) {
+    for (s32 i = 0; i < ArrayCount(x11_key_table); ++i) {
+        x11_key_table[i] = KEY_UNKNOWN;
+    }
+
+    s32 min_keycode, max_keycode, keysyms_per_keycode;
+    XDisplayKeycodes(display, &min_keycode, &max_keycode);
+    KeySym *keysyms = XGetKeyboardMapping(display, (KeyCode)min_keycode, max_keycode - min_keycode + 1, &keysyms_per_keycode);
+    if (!keysyms) return;
+    for (s32 keycode = min_keycode; keycode <= max_keycode && keycode < ArrayCount(x11_key_table); ++keycode) {
+        KeySym keysym = keysyms[(keycode - min_keycode) * keysyms_per_keycode];
+        // Letters are listed as upper case in the first column of some maps.
+        KeySym lower, upper;
+        XConvertCase(keysym, &lower, &upper);
+        x11_key_table[keycode] = x11_key_from_keysym(lower);
+    }
+    XFree(keysyms);
+}
+
+static Key x11_translate_key(s32 keycode) {
+    return keycode >= 0 && keycode < ArrayCount(x11_key_table) ? x11_key_table[keycode] : KEY_UNKNOWN;
+}
+
+// XI2 key events carry no text, Xutf8LookupString needs a core event.
+static XKeyEvent x11_make_key_event(XIDeviceEvent *device_event) {
+    XKeyEvent result = {0};
+    {
+        result.type        = KeyPress;
+        result.display     = device_event->display;
+        result.window      = device_event->event;
+        result.root        = device_event->root;
+        result.time        = device_event->time;
+        result.x           = (int)device_event->event_x;
+        result.y           = (int)device_event->event_y;
+        result.state       = (u32)device_event->mods.effective | ((u32)device_event->group.effective << 13);
+        result.keycode     = (u32)device_event->detail;
+        result.same_screen = True;
+    }
+    return result;
+}
+
+static void x11_push_characters(X11_Event_Thread *thread, XKeyEvent *key_event, Key_Modifiers key_modifiers) {
+    char text[64];
+    KeySym keysym;
+    Status status = XLookupChars;
+    b32 utf8 = thread->input_context != 0;
+    s32 size = 0;
+    if (utf8) {
+        size = Xutf8LookupString(thread->input_context, key_event, text, sizeof(text), &keysym, &status);
+    } else {
+        // Without an input method the text is Latin-1, which are the
+        // first 256 codepoints.
+        size = XLookupString(key_event, text, sizeof(text), &keysym, 0);
+    }
+    if (status != XLookupChars && status != XLookupBoth) return;
+
+    for (s32 at = 0; at < size;) {
+        u32 codepoint = (u8)text[at];
+        if (utf8) {
+            Unicode_Decode decode = str_utf8_decode((u8 *)text + at, (u64)(size - at));
+            codepoint = decode.codepoint;
+            at += decode.advance ? decode.advance : 1;
+        } else {
+            at += 1;
+        }
+        if (codepoint < 32 || codepoint == 127) continue;
+
+        Platform_Event event = {0};
+        {
+            event.type          = Platform_Event_Type_Character_Input;
+            event.character     = codepoint;
+            event.key_modifiers = key_modifiers;
+        }
+        platform_push_event(event);
+    }
+}
+
+static void x11_handle_input_event(X11_Event_Thread *thread, XGenericEventCookie *cookie) {
+    switch (cookie->evtype) {
+        case XI_KeyPress:
+        case XI_KeyRelease: {
+            XIDeviceEvent *device_event = (XIDeviceEvent *)cookie->data;
+            XKeyEvent key_event = x11_make_key_event(device_event);
+            Key_Modifiers key_modifiers = x11_get_modifiers((u32)device_event->mods.effective);
+            b32 is_down = cookie->evtype == XI_KeyPress;
+
+            Key key = x11_translate_key(device_event->detail);
+            if (key != KEY_UNKNOWN) {
+                Platform_Event event = {0};
+                {
+                    event.type          = is_down ? Platform_Event_Type_Key_Press : Platform_Event_Type_Key_Release;
+                    event.key           = key;
+                    event.key_modifiers = key_event_modifiers(key, key_modifiers);
+                }
+                platform_push_event(event);
+            }
+            if (is_down) x11_push_characters(thread, &key_event, key_modifiers);
+        } break;
+
+        case XI_ButtonPress:
+        case XI_ButtonRelease: {
+            XIDeviceEvent *device_event = (XIDeviceEvent *)cookie->data;
+            Key_Modifiers key_modifiers = x11_get_modifiers((u32)device_event->mods.effective);
+            b32 is_down = cookie->evtype == XI_ButtonPress;
+            s32 button = device_event->detail;
+
+            if (button == 4 || button == 5) {
+                // Wheel clicks come as buttons 4 and 5, once pressed and
+                // once released.
+                if (!is_down) break;
+                Platform_Event event = {0};
+                {
+                    event.type         = Platform_Event_Type_Mouse_Scroll;
+                    event.scroll_delta = button == 4 ? X11_SCROLL_STEP : -X11_SCROLL_STEP;
+                }
+                platform_push_event(event);
+            } else if (button == 1 || button == 3) {
+                Platform_Event event = {0};
+                {
+                    event.type          = is_down ? Platform_Event_Type_Mouse_Press : Platform_Event_Type_Mouse_Release;
+                    event.key           = button == 1 ? KEY_MOUSE_BUTTON_LEFT : KEY_MOUSE_BUTTON_RIGHT;
+                    event.key_modifiers = key_modifiers;
+                }
+                platform_push_event(event);
+            }
+        } break;
+
+        case XI_Motion: {
+            // Every sample of the device arrives here, the event queue
+            // coalesces them unless raw mouse events are turned on.
+            XIDeviceEvent *device_event = (XIDeviceEvent *)cookie->data;
+            Platform_Event event = {0};
+            {
+                event.type      = Platform_Event_Type_Mouse_Move;
+                event.mouse_pos = ivec2((s32)device_event->event_x, (s32)device_event->event_y);
+            }
+            platform_push_event(event);
+        } break;
+
+        case XI_Enter:
+        case XI_Leave: {
+            // Grabs also enter and leave, the pointer itself did not move.
+            XIEnterEvent *enter_event = (XIEnterEvent *)cookie->data;
+            if (enter_event->mode != XINotifyNormal) break;
+            Platform_Event event = {0};
+            {
+                event.type = cookie->evtype == XI_Enter ? Platform_Event_Type_Cursor_Enter : Platform_Event_Type_Cursor_Leave;
+            }
+            platform_push_event(event);
+        } break;
+    }
+}
+
+static void x11_handle_event(X11_Event_Thread *thread, XEvent *event) {
+    switch (event->type) {
+        case GenericEvent: {
+            XGenericEventCookie *cookie = &event->xcookie;
+            if (cookie->extension == thread->xi_opcode && XGetEventData(thread->display, cookie)) {
+                x11_handle_input_event(thread, cookie);
+                XFreeEventData(thread->display, cookie);
+            }
+        } break;
+
+        case ConfigureNotify: {
+            // The GL context belongs to the main thread, it picks the new
+            // size up at the start of the next frame.
+            s32 width  = event->xconfigure.width;
+            s32 height = event->xconfigure.height;
+            if (width != platform_state->window_width || height != platform_state->window_height) {
+                platform_state->window_width  = width;
+                platform_state->window_height = height;
+                platform_request_frame();
+            }
+        } break;
+
+        case Expose: {
+            platform_request_frame();
+        } break;
+
+        case MappingNotify: {
+            XRefreshKeyboardMapping(&event->xmapping);
+            if (event->xmapping.request == MappingKeyboard) x11_init_key_table(thread->display);
+        } break;
+
+        case ClientMessage: {
+            if ((Atom)event->xclient.data.l[0] == thread->wm_delete_window) {
+                atomic_store_u32(&platform_state->running, 0);
+                platform_request_frame();
+            }
+        } break;
+    }
+}
+
+// =========================
+// >> Event thread
+
+static b32 x11_create_window(X11_Event_Thread *thread) {
+    Display *display = thread->display;
+    s32 screen = DefaultScreen(display);
+
+    XVisualInfo visual_template = {0};
+    visual_template.visualid = thread->visual_id;
+    visual_template.screen   = screen;
+    s32 visual_count = 0;
+    XVisualInfo *visual = XGetVisualInfo(display, VisualIDMask | VisualScreenMask, &visual_template, &visual_count);
+    if (!visual) return 0;
+
+    Window root = RootWindow(display, screen);
+    XSetWindowAttributes attributes = {0};
+    {
+        attributes.colormap          = XCreateColormap(display, root, visual->visual, AllocNone);
+        attributes.background_pixel  = BlackPixel(display, screen);
+        attributes.border_pixel      = 0;
+        attributes.event_mask        = StructureNotifyMask | ExposureMask;
+    }
+    thread->window = XCreateWindow(display, root, 0, 0,
+                                   (u32)platform_state->window_width, (u32)platform_state->window_height,
+                                   0, visual->depth, InputOutput, visual->visual,
+                                   CWColormap | CWBackPixel | CWBorderPixel | CWEventMask, &attributes);
+    XFree(visual);
+    if (!thread->window) return 0;
+
+    XStoreName(display, thread->window, "app");
+    thread->wm_delete_window = XInternAtom(display, "WM_DELETE_WINDOW", False);
+    XSetWMProtocols(display, thread->window, &thread->wm_delete_window, 1);
+
+    u8 mask[XIMaskLen(XI_LASTEVENT)] = {0};
+    XISetMask(mask, XI_KeyPress);
+    XISetMask(mask, XI_KeyRelease);
+    XISetMask(mask, XI_ButtonPress);
+    XISetMask(mask, XI_ButtonRelease);
+    XISetMask(mask, XI_Motion);
+    XISetMask(mask, XI_Enter);
+    XISetMask(mask, XI_Leave);
+    XIEventMask event_mask = {0};
+    {
+        event_mask.deviceid = XIAllMasterDevices;
+        event_mask.mask_len = sizeof(mask);
+        event_mask.mask     = mask;
+    }
+    XISelectEvents(display, thread->window, &event_mask, 1);
+
+    thread->input_method = XOpenIM(display, 0, 0, 0);
+    if (thread->input_method) {
+        thread->input_context = XCreateIC(thread->input_method,
+                                          XNInputStyle, XIMPreeditNothing | XIMStatusNothing,
+                                          XNClientWindow, thread->window,
+                                          XNFocusWindow, thread->window,
+                                          (char *)0);
+    }
+
+    XMapWindow(display, thread->window);
+    // The main thread binds its GL context to the window right after this.
+    XSync(display, False);
+    return 1;
+}
+
+static void x11_event_thread_proc(void *data) {
+    X11_Event_Thread *thread = (X11_Event_Thread *)data;
+    b32 created = x11_create_window(thread);
+    if (created) x11_init_key_table(thread->display);
+    platform_thread_event_set(&thread->window_created);
+    if (!created) return;
+
+    Display *display = thread->display;
+    struct pollfd fds[2] = {0};
+    fds[0].fd     = ConnectionNumber(display);
+    fds[0].events = POLLIN;
+    fds[1].fd     = thread->wake_pipe[0];
+    fds[1].events = POLLIN;
+
+    // XPending reads whatever the socket has in one go and returns how
+    // many events that makes, they are all handled before polling again.
+    for (;;) {
+        s32 count = XPending(display);
+        for (s32 i = 0; i < count; ++i) {
+            XEvent event;
+            XNextEvent(display, &event);
+            x11_handle_event(thread, &event);
+        }
+        if (count) continue;
+
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) break;
+        if (fds[1].revents) break;
+    }
+
+    if (thread->input_context) XDestroyIC(thread->input_context);
+    if (thread->input_method)  XCloseIM(thread->input_method);
+    XDestroyWindow(display, thread->window);
+    XCloseDisplay(display);
+}
+
+// =========================
+// >> OpenGL context
+
+static b32 x11_choose_fb_config(Display *display, GLXFBConfig *config) {
+    int attributes[] = {
+        GLX_X_RENDERABLE,  True,
+        GLX_DRAWABLE_TYPE, GLX_WINDOW_BIT,
+        GLX_RENDER_TYPE,   GLX_RGBA_BIT,
+        GLX_DOUBLEBUFFER,  True,
+        GLX_RED_SIZE,      8,
+        GLX_GREEN_SIZE,    8,
+        GLX_BLUE_SIZE,     8,
+        GLX_ALPHA_SIZE,    8,
+        None
+    };
+    int count = 0;
+    GLXFBConfig *configs = glXChooseFBConfig(display, DefaultScreen(display), attributes, &count);
+    if (!configs || count == 0) return 0;
+    *config = configs[0];
+    XFree(configs);
+    return 1;
+}
+
+static GLXContext x11_create_opengl_context(Display *display, GLXFBConfig config) {
+    char *extensions = (char *)glXQueryExtensionsString(display, DefaultScreen(display));
+    X11_Create_Context_Attribs *create_context_attribs = (X11_Create_Context_Attribs *)
+        platform_get_gl_proc_address("glXCreateContextAttribsARB");
+
+    GLXContext context = 0;
+    if (create_context_attribs && linux_has_extension(extensions, "GLX_ARB_create_context")) {
+        int context_attribs[] = {
+            GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
+            GLX_CONTEXT_MINOR_VERSION_ARB, 3,
+            GLX_CONTEXT_PROFILE_MASK_ARB, GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB,
+            None
+        };
+        context = create_context_attribs(display, config, 0, True, context_attribs);
+    }
+    if (!context) {
+        context = glXCreateNewContext(display, config, GLX_RGBA_TYPE, 0, True);
+    }
+    return context;
+}
+
+static void x11_set_swap_interval(Display *display, Window window, s32 interval) {
+    char *extensions = (char *)glXQueryExtensionsString(display, DefaultScreen(display));
+    if (linux_has_extension(extensions, "GLX_EXT_swap_control")) {
+        X11_Swap_Interval_EXT *swap_interval = (X11_Swap_Interval_EXT *)platform_get_gl_proc_address("glXSwapIntervalEXT");
+        if (swap_interval) swap_interval(display, window, interval);
+    } else if (linux_has_extension(extensions, "GLX_MESA_swap_control")) {
+        X11_Swap_Interval_MESA *swap_interval = (X11_Swap_Interval_MESA *)platform_get_gl_proc_address("glXSwapIntervalMESA");
+        if (swap_interval) swap_interval((u32)interval);
+    }
+}
+
+static void x11_update_viewport(s32 *width, s32 *height) {
+    s32 window_width  = platform_state->window_width;
+    s32 window_height = platform_state->window_height;
+    if (window_width != *width || window_height != *height) {
+        *width  = window_width;
+        *height = window_height;
+        glViewport(0, 0, window_width, window_height);
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(0.0f, (f32)window_width, (f32)window_height, 0.0f, 0.0f, 1.0f);
+    }
+}
+
+int main(int argc, char **argv) {
+    platform_state = &global_platform_state;
+    {
+        platform_state->window_width  = PLATFORM_DEFAULT_WINDOW_WIDTH;
+        platform_state->window_height = PLATFORM_DEFAULT_WINDOW_HEIGHT;
+        platform_state->running       = 1;
+        platform_state->delta         = 0;
+    }
+    platform_event_queue_init(&platform_state->events);
+
+    // Has to come before any other Xlib call.
+    XInitThreads();
+    // Needed for Xutf8LookupString to return UTF-8.
+    setlocale(LC_CTYPE, "");
+    XSetLocaleModifiers("");
+
+    global_gl_display = XOpenDisplay(0);
+    X11_Event_Thread event_thread = {0};
+    event_thread.display = XOpenDisplay(0);
+    if (!global_gl_display || !event_thread.display) {
+        platform_log("Could not connect to the X server, is DISPLAY set?\n");
+        return -1;
+    }
+
+    s32 event, error, major = 2, minor = 0;
+    if (!XQueryExtension(event_thread.display, "XInputExtension", &event_thread.xi_opcode, &event, &error) ||
+        XIQueryVersion(event_thread.display, &major, &minor) != Success) {
+        platform_log("The X server does not support XInput2.\n");
+        return -1;
+    }
+
+    GLXFBConfig config;
+    if (!x11_choose_fb_config(global_gl_display, &config)) {
+        platform_log("No double buffered RGBA8 GLX config.\n");
+        return -1;
+    }
+    XVisualInfo *visual = glXGetVisualFromFBConfig(global_gl_display, config);
+    if (!visual) return -1;
+    event_thread.visual_id = visual->visualid;
+    XFree(visual);
+
+    if (pipe(event_thread.wake_pipe) != 0) return -1;
+    Platform_Thread event_thread_handle = platform_thread_create(x11_event_thread_proc, &event_thread, "X11 Events");
+    platform_thread_event_wait(&event_thread.window_created);
+    global_window = event_thread.window;
+    if (!global_window) {
+        platform_thread_join(event_thread_handle);
+        return -1;
+    }
+
+    global_gl_context = x11_create_opengl_context(global_gl_display, config);
+    if (!global_gl_context || !glXMakeCurrent(global_gl_display, global_window, global_gl_context)) {
+        platform_log("Could not create the GLX context.\n");
+        return -1;
+    }
+    x11_set_swap_interval(global_gl_display, global_window, 1); // enable v-sync
+
+    app_init();
+
+    s32 viewport_width  = 0;
+    s32 viewport_height = 0;
+    // running is cleared by the event thread. Input comes in through the
+    // event queue, so waiting for the next frame blocks on that.
+    while (atomic_load_u32(&platform_state->running)) {
+        // Also starts the frame's time, idle time is not part of it.
+        platform_wait_for_frame();
+        if (!atomic_load_u32(&platform_state->running)) break;
+
+        x11_update_viewport(&viewport_width, &viewport_height);
+
+        app_update();
+    }
+
+    app_shutdown();
+
+    glXMakeCurrent(global_gl_display, None, 0);
+    glXDestroyContext(global_gl_display, global_gl_context);
+
+    u8 wake = 1;
+    write(event_thread.wake_pipe[1], &wake, 1);
+    platform_thread_join(event_thread_handle);
+    close(event_thread.wake_pipe[0]);
+    close(event_thread.wake_pipe[1]);
+    XCloseDisplay(global_gl_display);
+
+    return 0;
+}
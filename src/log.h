@@ -0,0 +1,982 @@
+/* log.h - v0.1 - Sven A. Schreiber
+ *
+ * log.h is a single header file library for logging without slowing
+ * down the thread that logs. It is part of and depends on my C
+ * base-layer.
+ *
+ * A log call does not format anything. It walks the format string,
+ * copies the raw arguments behind the format pointer into a ring buffer
+ * owned by the calling thread and returns. A background thread takes
+ * the records out of all rings in time order, formats them and hands
+ * the text to the sink, which is platform_log by default. The format
+ * must therefore stay valid until it is written, which string literals
+ * always do. Strings passed for %s are copied, up to
+ * LOG_MAX_STRING_ARG bytes.
+ *
+ * printf conversions are supported with the length modifiers hh, h,
+ * l, ll, z, j and t and * for width and precision. L and %n are not,
+ * such a conversion is written out as it is.
+ *
+ * LogTrace to LogFatal drop everything below LOG_MIN_LEVEL at compile
+ * time, arguments included. When a thread's ring is full, its records
+ * are dropped and counted instead of waiting. Errors and full rings
+ * wake the writer right away, the rest is written every
+ * LOG_FLUSH_INTERVAL_MS. log_flush writes everything out on the calling
+ * thread, and so does the crash handler that log_init installs.
+ *
+ * Timestamps come from cpu_cycle_counter. The writer turns them into
+ * time with platform_get_cycles_per_ns, which follows the recalibration
+ * the platform layer does about once a second.
+ *
+ * Binary log
+ * ----------
+ * After log_open_binary the records are not formatted at all. The
+ * writer stores the format id, the packed arguments and the timestamp
+ * in a file it writes through a mapped view. Every format is written
+ * once, the first time it is used. Only records of
+ * LOG_BINARY_TEXT_LEVEL and above still go to the sink as text.
+ * tools/log_decode.c turns such a file back into text.
+ *
+ * File format (little endian):
+ *   u32 magic, u32 version
+ *   entries, each an u8 tag followed by its fields, until a 0 tag:
+ *     Format:  varint id, varint size, the format without its zero
+ *     Sync:    u64 cycles, u64 ns, for turning cycles into time
+ *     Record:  varint format id, u8 level, varint thread id,
+ *              zigzag varint cycles since the previous record or sync,
+ *              varint size, the packed arguments
+ *     Dropped: varint thread id, varint count
+ *
+ * Packed arguments follow the conversions of the format: star widths
+ * and precisions, integers and pointers as zigzag varints, doubles as
+ * 8 bytes, strings as a varint size and the bytes.
+ *
+ * To use this file simply define LOG_IMPL once at the start of
+ * your project before including it. After that you can include it
+ * without defining LOG_IMPL as per usual.
+ *
+ * Example:
+ * ...
+ * #define LOG_IMPL
+ * #include "log.h"
+ * ...
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+// +============+
+// | DEFINTIONS |
+// +============+
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_WARN  3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_FATAL 5
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_TRACE
+#endif
+
+#define LOG_MAX_THREADS 64
+#define LOG_RING_SIZE KB(64) // Must be a power of two.
+#define LOG_MAX_RECORD_SIZE 1024
+#define LOG_MAX_STRING_ARG 256
+#define LOG_FLUSH_INTERVAL_MS 10
+#define LOG_OUTPUT_SIZE KB(16)
+
+#define LOG_BINARY_MAGIC 0x474F4C42 // "BLOG"
+#define LOG_BINARY_VERSION 1
+#define LOG_BINARY_VIEW_SIZE MB(4) // A multiple of PLATFORM_MAP_VIEW_ALIGNMENT.
+#define LOG_BINARY_MAX_FORMATS 4096 // Must be a power of two.
+#define LOG_BINARY_TEXT_LEVEL LOG_LEVEL_WARN
+
+typedef u32 Log_Level;
+
+typedef void Log_Sink_Proc(String text, void *data);
+
+// A record is followed by its arguments: 8 bytes for every number and
+// pointer, an u32 length, the bytes and a zero for every string, each
+// padded to 8 bytes. Records are padded to 16 bytes, and ones without
+// format pad out the end of the ring.
+typedef struct Log_Record Log_Record;
+struct Log_Record {
+    char *format;
+    u32 size;
+    u16 level;
+    u16 used; // Size without the padding.
+    u64 cycles;
+};
+
+typedef struct Log_Ring Log_Ring;
+struct Log_Ring {
+    volatile u64 head;
+    u8 pad0[56];
+    volatile u64 tail;
+    volatile u64 dropped;
+    u64 dropped_reported;
+    u8 *data;
+    u32 thread_id;
+    b32 shared; // Used by all threads that found no ring of their own.
+    Platform_Mutex mutex;
+};
+
+typedef enum Log_Binary_Tag Log_Binary_Tag;
+enum Log_Binary_Tag {
+    Log_Binary_Tag_End,
+    Log_Binary_Tag_Format,
+    Log_Binary_Tag_Sync,
+    Log_Binary_Tag_Record,
+    Log_Binary_Tag_Dropped
+};
+
+typedef struct Log_Binary Log_Binary;
+struct Log_Binary {
+    Platform_File_Handle file;
+    u8 *view;
+    u64 view_offset;
+    u64 view_used;
+    u64 last_cycles;
+    b32 failed;
+    u64 formats_full; // Records dropped because the format table was full.
+    char *formats[LOG_BINARY_MAX_FORMATS]; // By pointer, the slot is the id.
+};
+
+typedef struct Logger Logger;
+struct Logger {
+    b32 initialized;
+    volatile u32 stop;
+    volatile u32 wake;
+    volatile Log_Level level;
+    u64 start_cycles;
+    u64 start_ns;
+    f64 cycles_per_ns;
+    Log_Sink_Proc *sink;
+    void *sink_data;
+    Platform_Thread thread;
+
+    Platform_Mutex register_mutex;
+    Log_Ring *rings[LOG_MAX_THREADS];
+    volatile u32 ring_count;
+    Log_Ring shared_ring;
+
+    // Only touched by whoever holds drain_mutex.
+    Platform_Mutex drain_mutex;
+    u8 output[LOG_OUTPUT_SIZE];
+    u64 output_used;
+    Log_Binary *binary;
+};
+
+
+// +===========+
+// | INTERFACE |
+// +===========+
+
+void log_init(Log_Sink_Proc *sink, void *sink_data);
+void log_shutdown();
+void log_set_level(Log_Level level);
+void log_write(Log_Level level, char *format, ...);
+void log_flush();
+u64 log_get_dropped_count();
+b32 log_open_binary(char *file_name);
+
+
+// +===============+
+// | HELPER MACROS |
+// +===============+
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_TRACE
+#define LogTrace(...) log_write(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LogTrace(...)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LogDebug(...) log_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LogDebug(...)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LogInfo(...) log_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LogInfo(...)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARN
+#define LogWarn(...) log_write(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LogWarn(...)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define LogError(...) log_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LogError(...)
+#endif
+
+// Fatal messages are never stripped and flushed before LogFatal returns.
+#define LogFatal(...) (log_write(LOG_LEVEL_FATAL, __VA_ARGS__), log_flush())
+
+
+// +================+
+// | IMPLEMENTATION |
+// +================+
+
+#ifdef LOG_IMPL
+
+static Logger logger;
+static ThreadLocal Log_Ring *log_thread_ring;
+
+static char *log_level_names[] = {
+    "TRACE", "DEBUG", "INFO ", "WARN ", "ERROR", "FATAL"
+};
+
+// =========================
+// >> Format parsing
+//
+// Capturing and formatting walk the format the same way, so both agree
+// on what every argument is.
+
+typedef enum Log_Arg_Kind Log_Arg_Kind;
+enum Log_Arg_Kind {
+    Log_Arg_Kind_None, // Not a conversion we support, written as it is. Ends the capture.
+    Log_Arg_Kind_Percent,
+    Log_Arg_Kind_Int,
+    Log_Arg_Kind_Long,
+    Log_Arg_Kind_Int64,
+    Log_Arg_Kind_Double,
+    Log_Arg_Kind_Pointer,
+    Log_Arg_Kind_String
+};
+
+typedef struct Log_Spec Log_Spec;
+struct Log_Spec {
+    char *begin; // At the '%'.
+    char *end;   // Behind the conversion.
+    Log_Arg_Kind kind;
+    b32 width_star;
+    b32 precision_star;
+    b32 has_precision;
+    s32 precision;
+};
+
+static char *log_parse_spec(char *at, Log_Spec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    spec->begin = at++;
+
+    while (*at == '-' || *at == '+' || *at == ' ' || *at == '#' || *at == '0') at++;
+    if (*at == '*') {
+        spec->width_star = 1;
+        at++;
+    } else {
+        while (*at >= '0' && *at <= '9') at++;
+    }
+    if (*at == '.') {
+        spec->has_precision = 1;
+        at++;
+        if (*at == '*') {
+            spec->precision_star = 1;
+            at++;
+        } else {
+            while (*at >= '0' && *at <= '9') {
+                spec->precision = spec->precision * 10 + (*at - '0');
+                at++;
+            }
+        }
+    }
+
+    Log_Arg_Kind integer_kind = Log_Arg_Kind_Int;
+    b32 long_double = 0;
+    if (at[0] == 'h') {
+        at += (at[1] == 'h') ? 2 : 1;
+    } else if (at[0] == 'l' && at[1] == 'l') {
+        integer_kind = Log_Arg_Kind_Int64;
+        at += 2;
+    } else if (at[0] == 'l') {
+        integer_kind = Log_Arg_Kind_Long;
+        at += 1;
+    } else if (at[0] == 'z' || at[0] == 'j' || at[0] == 't') {
+        integer_kind = Log_Arg_Kind_Int64;
+        at += 1;
+    } else if (at[0] == 'L') {
+        long_double = 1;
+        at += 1;
+    }
+
+    switch (*at) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c': {
+            spec->kind = integer_kind;
+        } break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+            spec->kind = long_double ? Log_Arg_Kind_None : Log_Arg_Kind_Double;
+        } break;
+        case 'p': spec->kind = Log_Arg_Kind_Pointer; break;
+        case 's': {
+            // %ls takes a wchar_t string.
+            spec->kind = integer_kind == Log_Arg_Kind_Long ? Log_Arg_Kind_None : Log_Arg_Kind_String;
+        } break;
+        case '%': spec->kind = Log_Arg_Kind_Percent; break;
+        default:  spec->kind = Log_Arg_Kind_None; break;
+    }
+    if (spec->kind == Log_Arg_Kind_None) {
+        spec->width_star = spec->precision_star = 0;
+    }
+    if (*at) at++;
+    spec->end = at;
+    return at;
+}
+
+
+// =========================
+// >> Capture
+
+static Log_Ring *log_ring_create(u32 thread_id) {
+    u64 size = sizeof(Log_Ring) + LOG_RING_SIZE;
+    u8 *memory = (u8 *)platform_reserve_memory(size);
+    if (!memory) return 0;
+    platform_commit_memory(memory, size);
+    Log_Ring *ring = (Log_Ring *)memory;
+    memset(ring, 0, sizeof(*ring));
+    ring->data = memory + sizeof(Log_Ring);
+    ring->thread_id = thread_id;
+    return ring;
+}
+
+static Log_Ring *log_get_thread_ring() {
+    Log_Ring *ring = log_thread_ring;
+    if (ring) return ring;
+
+    platform_mutex_lock(&logger.register_mutex);
+    u32 count = logger.ring_count;
+    if (count < LOG_MAX_THREADS) {
+        ring = log_ring_create(platform_get_thread_id());
+    }
+    if (ring) {
+        logger.rings[count] = ring;
+        atomic_store_u32(&logger.ring_count, count + 1);
+    } else {
+        ring = &logger.shared_ring;
+    }
+    platform_mutex_unlock(&logger.register_mutex);
+
+    log_thread_ring = ring;
+    return ring;
+}
+
+static void log_ring_push(Log_Ring *ring, u8 *record, u32 size, b32 urgent) {
+    if (ring->shared) platform_mutex_lock(&ring->mutex);
+
+    u64 head = ring->head;
+    u64 tail = atomic_load_u64(&ring->tail);
+    u64 offset = head & (LOG_RING_SIZE - 1);
+    u64 padding = (offset + size > LOG_RING_SIZE) ? LOG_RING_SIZE - offset : 0;
+
+    if (head + padding + size - tail > LOG_RING_SIZE) {
+        atomic_fetch_add_u64(&ring->dropped, 1);
+        urgent = 1;
+    } else {
+        if (padding) {
+            Log_Record *pad = (Log_Record *)(ring->data + offset);
+            pad->size = (u32)padding;
+            pad->format = 0;
+        }
+        memcpy(ring->data + ((head + padding) & (LOG_RING_SIZE - 1)), record, size);
+        atomic_store_u64(&ring->head, head + padding + size);
+        if (head + padding + size - tail > LOG_RING_SIZE / 2) urgent = 1;
+    }
+
+    if (ring->shared) platform_mutex_unlock(&ring->mutex);
+
+    if (urgent) {
+        atomic_fetch_add_u32(&logger.wake, 1);
+        platform_futex_wake(&logger.wake, 0);
+    }
+}
+
+// Copies the arguments the format asks for behind the record header.
+static u32 log_capture(u8 *record, char *format, va_list args) {
+    u32 size = sizeof(Log_Record);
+    for (char *at = format; *at;) {
+        if (*at != '%') {
+            at++;
+            continue;
+        }
+        Log_Spec spec;
+        at = log_parse_spec(at, &spec);
+
+        // A conversion that does not fit ends the record, the formatter
+        // then leaves it and all after it out.
+        u32 needed = 8 * (spec.width_star + spec.precision_star);
+        if (spec.kind >= Log_Arg_Kind_Int) needed += 8;
+        if (size + needed > LOG_MAX_RECORD_SIZE - 16) break;
+
+        s64 star_precision = -1;
+        if (spec.width_star) {
+            *(s64 *)(record + size) = va_arg(args, int);
+            size += 8;
+        }
+        if (spec.precision_star) {
+            star_precision = va_arg(args, int);
+            *(s64 *)(record + size) = star_precision;
+            size += 8;
+        }
+
+        u64 value = 0;
+        switch (spec.kind) {
+            case Log_Arg_Kind_Int:     value = (u64)(s64)va_arg(args, int); break;
+            case Log_Arg_Kind_Long:    value = (u64)(s64)va_arg(args, long); break;
+            case Log_Arg_Kind_Int64:   value = (u64)va_arg(args, long long); break;
+            case Log_Arg_Kind_Pointer: value = (u64)(uintptr_t)va_arg(args, void *); break;
+            case Log_Arg_Kind_Double: {
+                f64 number = va_arg(args, f64);
+                memcpy(&value, &number, sizeof(value));
+            } break;
+
+            case Log_Arg_Kind_String: {
+                char *string = va_arg(args, char *);
+                if (!string) string = "(null)";
+                s64 limit = LOG_MAX_STRING_ARG;
+                if (spec.precision_star && star_precision >= 0 && star_precision < limit) limit = star_precision;
+                if (!spec.precision_star && spec.has_precision && spec.precision < limit) limit = spec.precision;
+                s64 space = (s64)LOG_MAX_RECORD_SIZE - 16 - size - 5;
+                if (limit > space) limit = space;
+                if (limit < 0) return size;
+
+                u32 length = 0;
+                while (length < limit && string[length]) length++;
+                *(u32 *)(record + size) = length;
+                memcpy(record + size + 4, string, length);
+                record[size + 4 + length] = 0;
+                size += AlignPow2(4 + length + 1, 8);
+            } continue;
+
+            // The size of its argument is unknown, everything after it
+            // would be read from the wrong place.
+            case Log_Arg_Kind_None: return size;
+
+            default: continue;
+        }
+        *(u64 *)(record + size) = value;
+        size += 8;
+    }
+    return size;
+}
+
+void log_write(Log_Level level, char *format, ...) {
+    if (level < atomic_load_u32(&logger.level)) return;
+
+    va_list args;
+    va_start(args, format);
+    if (!logger.initialized) {
+        char buffer[LOG_MAX_RECORD_SIZE];
+        vsnprintf(buffer, sizeof(buffer), format, args);
+        platform_log("%s", buffer);
+        va_end(args);
+        return;
+    }
+
+    u64 buffer[LOG_MAX_RECORD_SIZE / 8];
+    u8 *record = (u8 *)buffer;
+    u32 used = log_capture(record, format, args);
+    va_end(args);
+
+    Log_Record *header = (Log_Record *)record;
+    header->size    = AlignPow2(used, 16);
+    header->used    = (u16)used;
+    header->level   = (u16)level;
+    header->cycles  = cpu_cycle_counter();
+    header->format  = format;
+    log_ring_push(log_get_thread_ring(), record, header->size, level >= LOG_LEVEL_ERROR);
+}
+
+
+// =========================
+// >> Output
+
+static void log_output_flush() {
+    if (logger.output_used) {
+        String text = {0};
+        text.str = logger.output;
+        text.size = logger.output_used;
+        logger.sink(text, logger.sink_data);
+        logger.output_used = 0;
+    }
+}
+
+static char *log_output_reserve(u64 size) {
+    if (logger.output_used + size > LOG_OUTPUT_SIZE) log_output_flush();
+    return (char *)logger.output + logger.output_used;
+}
+
+static void log_output_append(char *text, u64 size) {
+    char *dest = log_output_reserve(size);
+    memcpy(dest, text, size);
+    logger.output_used += size;
+}
+
+// Writes the text of one conversion. Star arguments are put into the
+// spec as digits, so every kind needs only one snprintf.
+static u8 *log_format_spec(Log_Spec *spec, u8 *args, char *dest, u64 capacity, u64 *written) {
+    char format[64];
+    u64 format_size = 0;
+    s64 width = 0;
+    s64 precision = -1;
+    if (spec->width_star) {
+        width = *(s64 *)args;
+        args += 8;
+    }
+    if (spec->precision_star) {
+        precision = *(s64 *)args;
+        args += 8;
+    }
+
+    for (char *at = spec->begin; at < spec->end && format_size < sizeof(format) - 24; ++at) {
+        if (*at == '*' && at[-1] == '.') {
+            if (precision >= 0) {
+                format_size += snprintf(format + format_size, 24, "%lld", (long long)precision);
+            } else {
+                format_size -= 1; // A negative precision counts as none.
+            }
+        } else if (*at == '*') {
+            format_size += snprintf(format + format_size, 24, "%lld", (long long)width);
+        } else {
+            format[format_size++] = *at;
+        }
+    }
+    format[format_size] = 0;
+
+    int result = 0;
+    switch (spec->kind) {
+        case Log_Arg_Kind_Int: {
+            result = snprintf(dest, capacity, format, (int)*(s64 *)args);
+            args += 8;
+        } break;
+        case Log_Arg_Kind_Long: {
+            result = snprintf(dest, capacity, format, (long)*(s64 *)args);
+            args += 8;
+        } break;
+        case Log_Arg_Kind_Int64: {
+            result = snprintf(dest, capacity, format, *(long long *)args);
+            args += 8;
+        } break;
+        case Log_Arg_Kind_Pointer: {
+            result = snprintf(dest, capacity, format, (void *)(uintptr_t)*(u64 *)args);
+            args += 8;
+        } break;
+        case Log_Arg_Kind_Double: {
+            result = snprintf(dest, capacity, format, *(f64 *)args);
+            args += 8;
+        } break;
+        case Log_Arg_Kind_String: {
+            u32 length = *(u32 *)args;
+            result = snprintf(dest, capacity, format, (char *)(args + 4));
+            args += AlignPow2(4 + length + 1, 8);
+        } break;
+        case Log_Arg_Kind_Percent: {
+            result = snprintf(dest, capacity, "%%");
+        } break;
+        default: {
+            result = snprintf(dest, capacity, "%.*s", (int)(spec->end - spec->begin), spec->begin);
+        } break;
+    }
+    if (result < 0) result = 0;
+    *written = Min((u64)result, capacity - 1);
+    return args;
+}
+
+static void log_format_record(Log_Record *record) {
+    u8 *args = (u8 *)(record + 1);
+    u8 *args_end = (u8 *)record + record->used;
+
+    char prefix[64];
+    f64 seconds = (f64)(s64)(record->cycles - logger.start_cycles) / logger.cycles_per_ns / 1000000000.0;
+    int prefix_size = snprintf(prefix, sizeof(prefix), "[%12.6f] %s ", seconds, log_level_names[Min(record->level, LOG_LEVEL_FATAL)]);
+    log_output_append(prefix, prefix_size);
+
+    char *text = record->format;
+    b32 newline = 0;
+    for (char *at = record->format;; ) {
+        if (*at != '%' && *at != 0) {
+            at++;
+            continue;
+        }
+        if (at > text) {
+            log_output_append(text, at - text);
+            newline = at[-1] == '\n';
+        }
+        if (*at == 0) break;
+
+        Log_Spec spec;
+        at = log_parse_spec(at, &spec);
+        text = at;
+
+        u64 capacity = LOG_MAX_RECORD_SIZE;
+        char *dest = log_output_reserve(capacity);
+        u64 written = 0;
+        if (args < args_end || spec.kind == Log_Arg_Kind_Percent || spec.kind == Log_Arg_Kind_None) {
+            args = log_format_spec(&spec, args, dest, capacity, &written);
+        }
+        logger.output_used += written;
+        if (written) newline = dest[written - 1] == '\n';
+    }
+    if (!newline) log_output_append("\n", 1);
+}
+
+
+// =========================
+// >> Binary log
+
+static u32 log_put_varint(u8 *dest, u64 value) {
+    u32 size = 0;
+    while (value >= 0x80) {
+        dest[size++] = (u8)(value | 0x80);
+        value >>= 7;
+    }
+    dest[size++] = (u8)value;
+    return size;
+}
+
+static u32 log_put_svarint(u8 *dest, s64 value) {
+    return log_put_varint(dest, ((u64)value << 1) ^ (u64)(value >> 63));
+}
+
+// Packs the arguments of a record as they were captured, dest needs
+// 2 * LOG_MAX_RECORD_SIZE bytes.
+static u32 log_pack_args(Log_Record *record, u8 *dest) {
+    u8 *args = (u8 *)(record + 1);
+    u8 *args_end = (u8 *)record + record->used;
+    u32 size = 0;
+    for (char *at = record->format; *at && args < args_end;) {
+        if (*at != '%') {
+            at++;
+            continue;
+        }
+        Log_Spec spec;
+        at = log_parse_spec(at, &spec);
+        u32 stars = spec.width_star + spec.precision_star;
+        for (u32 i = 0; i < stars; ++i) {
+            size += log_put_svarint(dest + size, *(s64 *)args);
+            args += 8;
+        }
+        switch (spec.kind) {
+            case Log_Arg_Kind_Int:
+            case Log_Arg_Kind_Long:
+            case Log_Arg_Kind_Int64:
+            case Log_Arg_Kind_Pointer: {
+                size += log_put_svarint(dest + size, *(s64 *)args);
+                args += 8;
+            } break;
+            case Log_Arg_Kind_Double: {
+                memcpy(dest + size, args, 8);
+                size += 8;
+                args += 8;
+            } break;
+            case Log_Arg_Kind_String: {
+                u32 length = *(u32 *)args;
+                size += log_put_varint(dest + size, length);
+                memcpy(dest + size, args + 4, length);
+                size += length;
+                args += AlignPow2(4 + length + 1, 8);
+            } break;
+        }
+    }
+    return size;
+}
+
+static void log_binary_write(Log_Binary *binary, void *data, u64 size) {
+    u8 *bytes = (u8 *)data;
+    while (size > 0 && !binary->failed) {
+        if (binary->view_used == LOG_BINARY_VIEW_SIZE) {
+            platform_unmap_file_view(binary->view, LOG_BINARY_VIEW_SIZE);
+            binary->view_offset += LOG_BINARY_VIEW_SIZE;
+            binary->view_used = 0;
+            binary->view = (u8 *)platform_map_file_view(binary->file, binary->view_offset, LOG_BINARY_VIEW_SIZE);
+            if (!binary->view) {
+                binary->failed = 1;
+                break;
+            }
+        }
+        u64 part = Min(size, LOG_BINARY_VIEW_SIZE - binary->view_used);
+        memcpy(binary->view + binary->view_used, bytes, part);
+        binary->view_used += part;
+        bytes += part;
+        size -= part;
+    }
+}
+
+// Returns the id of format, which is written to the file the first time.
+static b32 log_binary_format_id(Log_Binary *binary, char *format, u32 *id) {
+    u32 index = (u32)(((uintptr_t)format >> 3) * 0x9E3779B1u) & (LOG_BINARY_MAX_FORMATS - 1);
+    for (u32 probe = 0; probe < LOG_BINARY_MAX_FORMATS; ++probe) {
+        char *slot = binary->formats[index];
+        if (slot == format) {
+            *id = index;
+            return 1;
+        }
+        if (!slot) {
+            binary->formats[index] = format;
+            u64 length = strlen(format);
+            u8 entry[32];
+            u32 size = 0;
+            entry[size++] = Log_Binary_Tag_Format;
+            size += log_put_varint(entry + size, index);
+            size += log_put_varint(entry + size, length);
+            log_binary_write(binary, entry, size);
+            log_binary_write(binary, format, length);
+            *id = index;
+            return 1;
+        }
+        index = (index + 1) & (LOG_BINARY_MAX_FORMATS - 1);
+    }
+    return 0;
+}
+
+// Record times are relative to the previous record or sync.
+static void log_binary_sync(Log_Binary *binary, u64 cycles, u64 ns) {
+    u8 entry[17];
+    entry[0] = Log_Binary_Tag_Sync;
+    memcpy(entry + 1, &cycles, 8);
+    memcpy(entry + 9, &ns, 8);
+    log_binary_write(binary, entry, sizeof(entry));
+    binary->last_cycles = cycles;
+}
+
+static void log_binary_record(Log_Binary *binary, Log_Record *record, u32 thread_id) {
+    u32 id;
+    if (!log_binary_format_id(binary, record->format, &id)) {
+        binary->formats_full += 1;
+        return;
+    }
+
+    u8 entry[3 * LOG_MAX_RECORD_SIZE];
+    u32 size = 0;
+    entry[size++] = Log_Binary_Tag_Record;
+    size += log_put_varint(entry + size, id);
+    entry[size++] = (u8)record->level;
+    size += log_put_varint(entry + size, thread_id);
+    size += log_put_svarint(entry + size, (s64)(record->cycles - binary->last_cycles));
+    u8 *packed = entry + LOG_MAX_RECORD_SIZE;
+    u32 packed_size = log_pack_args(record, packed);
+    size += log_put_varint(entry + size, packed_size);
+    memmove(entry + size, packed, packed_size);
+    size += packed_size;
+    log_binary_write(binary, entry, size);
+    binary->last_cycles = record->cycles;
+}
+
+static void log_binary_dropped(Log_Binary *binary, u32 thread_id, u64 count) {
+    u8 entry[32];
+    u32 size = 0;
+    entry[size++] = Log_Binary_Tag_Dropped;
+    size += log_put_varint(entry + size, thread_id);
+    size += log_put_varint(entry + size, count);
+    log_binary_write(binary, entry, size);
+}
+
+// Cuts the file down to what was written. The view is unmapped first,
+// Windows does not shrink mapped files.
+static void log_binary_close(Log_Binary *binary) {
+    u64 size = binary->view_offset + binary->view_used;
+    platform_unmap_file_view(binary->view, LOG_BINARY_VIEW_SIZE);
+    platform_set_file_size(binary->file, size);
+    platform_close_file(binary->file);
+    platform_release_memory(binary, sizeof(Log_Binary));
+}
+
+
+// =========================
+// >> Draining
+
+static Log_Record *log_ring_peek(Log_Ring *ring) {
+    for (;;) {
+        u64 tail = ring->tail;
+        if (tail == atomic_load_u64(&ring->head)) return 0;
+        Log_Record *record = (Log_Record *)(ring->data + (tail & (LOG_RING_SIZE - 1)));
+        if (record->format) return record;
+        atomic_store_u64(&ring->tail, tail + record->size);
+    }
+}
+
+static void log_report_dropped(Log_Ring *ring) {
+    u64 dropped = atomic_load_u64(&ring->dropped);
+    if (dropped != ring->dropped_reported && logger.binary) {
+        log_binary_dropped(logger.binary, ring->thread_id, dropped - ring->dropped_reported);
+        ring->dropped_reported = dropped;
+    } else if (dropped != ring->dropped_reported) {
+        char text[128];
+        int size = snprintf(text, sizeof(text), "[log] %llu messages of thread %u were dropped.\n",
+                            (unsigned long long)(dropped - ring->dropped_reported), ring->thread_id);
+        log_output_append(text, size);
+        ring->dropped_reported = dropped;
+    }
+}
+
+// Writes everything that is in the rings right now, oldest first. The
+// caller holds drain_mutex. The crash handler calls it as well, so it
+// must not take any lock of the platform layer: the rate was measured
+// in log_init already, reading it again only loads it.
+static void log_drain() {
+    logger.cycles_per_ns = platform_get_cycles_per_ns();
+    Log_Binary *binary = logger.binary;
+    b32 wrote_binary = 0;
+
+    u32 ring_count = atomic_load_u32(&logger.ring_count);
+    for (;;) {
+        Log_Ring *oldest_ring = 0;
+        Log_Record *oldest = 0;
+        for (u32 i = 0; i <= ring_count; ++i) {
+            Log_Ring *ring = (i < ring_count) ? logger.rings[i] : &logger.shared_ring;
+            Log_Record *record = log_ring_peek(ring);
+            if (record && (!oldest || (s64)(record->cycles - oldest->cycles) < 0)) {
+                oldest = record;
+                oldest_ring = ring;
+            }
+        }
+        if (!oldest) break;
+
+        if (binary) {
+            log_binary_record(binary, oldest, oldest_ring->thread_id);
+            wrote_binary = 1;
+        }
+        if (!binary || oldest->level >= LOG_BINARY_TEXT_LEVEL) {
+            log_format_record(oldest);
+        }
+        atomic_store_u64(&oldest_ring->tail, oldest_ring->tail + oldest->size);
+    }
+    for (u32 i = 0; i < ring_count; ++i) log_report_dropped(logger.rings[i]);
+    log_report_dropped(&logger.shared_ring);
+    if (wrote_binary) log_binary_sync(binary, cpu_cycle_counter(), platform_get_time_ns());
+    log_output_flush();
+}
+
+static void log_thread_proc(void *data) {
+    while (!atomic_load_u32(&logger.stop)) {
+        u32 wake = atomic_load_u32(&logger.wake);
+        platform_mutex_lock(&logger.drain_mutex);
+        log_drain();
+        platform_mutex_unlock(&logger.drain_mutex);
+        platform_futex_wait_timeout(&logger.wake, wake, LOG_FLUSH_INTERVAL_MS);
+    }
+}
+
+void log_flush() {
+    if (!logger.initialized) return;
+    platform_mutex_lock(&logger.drain_mutex);
+    log_drain();
+    platform_mutex_unlock(&logger.drain_mutex);
+}
+
+// Runs on the crashing thread. If the lock does not come free within
+// 100 ms, the writer crashed while draining or is stuck. Draining next
+// to it would move the same ring tails twice, so the records still
+// queued are given up and only that is reported.
+static void log_crash_handler() {
+    if (!logger.initialized) return;
+    b32 locked = 0;
+    for (u32 i = 0; i < 1000 && !locked; ++i) {
+        locked = platform_mutex_try_lock(&logger.drain_mutex);
+        if (!locked) platform_sleep_ns(100000);
+    }
+    if (!locked) {
+        platform_log("[log] The log writer is busy, the messages still queued are lost.\n");
+        return;
+    }
+    log_drain();
+    platform_mutex_unlock(&logger.drain_mutex);
+}
+
+static void log_platform_sink(String text, void *data) {
+    // platform_log formats into a small buffer on some platforms.
+    while (text.size > 0) {
+        u64 size = Min(text.size, 512);
+        platform_log("%.*s", (int)size, text.str);
+        text = str_substring(text, size, text.size);
+    }
+}
+
+
+// =========================
+// >> Setup
+
+// sink of 0 writes through platform_log.
+void log_init(Log_Sink_Proc *sink, void *sink_data) {
+    memset(&logger, 0, sizeof(logger));
+    logger.sink          = sink ? sink : log_platform_sink;
+    logger.sink_data     = sink_data;
+    logger.start_cycles  = cpu_cycle_counter();
+    logger.start_ns      = platform_get_time_ns();
+    logger.cycles_per_ns = platform_get_cycles_per_ns();
+    logger.shared_ring.data   = (u8 *)platform_reserve_memory(LOG_RING_SIZE);
+    logger.shared_ring.shared = 1;
+    platform_commit_memory(logger.shared_ring.data, LOG_RING_SIZE);
+
+    logger.initialized = 1;
+    logger.thread = platform_thread_create(log_thread_proc, 0, "Log Writer");
+    platform_set_crash_handler(log_crash_handler);
+}
+
+void log_shutdown() {
+    if (!logger.initialized) return;
+    atomic_store_u32(&logger.stop, 1);
+    atomic_fetch_add_u32(&logger.wake, 1);
+    platform_futex_wake(&logger.wake, 1);
+    platform_thread_join(logger.thread);
+    log_flush();
+    if (logger.binary) {
+        log_binary_close(logger.binary);
+        logger.binary = 0;
+    }
+    platform_set_crash_handler(0);
+    logger.initialized = 0;
+}
+
+// Records are written to file_name in binary from now on, see the top of
+// this file. Call it after log_init.
+b32 log_open_binary(char *file_name) {
+    Log_Binary *binary = (Log_Binary *)platform_reserve_memory(sizeof(Log_Binary));
+    if (!binary) return 0;
+    platform_commit_memory(binary, sizeof(Log_Binary));
+    memset(binary, 0, sizeof(*binary));
+
+    binary->file = platform_open_file(file_name, Platform_File_Flag_Read | Platform_File_Flag_Write | Platform_File_Flag_Create | Platform_File_Flag_Truncate);
+    if (platform_file_handle_is_valid(binary->file)) {
+        binary->view = (u8 *)platform_map_file_view(binary->file, 0, LOG_BINARY_VIEW_SIZE);
+    }
+    if (!binary->view) {
+        platform_close_file(binary->file);
+        platform_release_memory(binary, sizeof(Log_Binary));
+        return 0;
+    }
+
+    u32 header[2] = { LOG_BINARY_MAGIC, LOG_BINARY_VERSION };
+    log_binary_write(binary, header, sizeof(header));
+    // Starting at the same time as the logger keeps the decoded times the
+    // same as the text ones.
+    log_binary_sync(binary, logger.start_cycles, logger.start_ns);
+
+    platform_mutex_lock(&logger.drain_mutex);
+    log_drain();
+    logger.binary = binary;
+    platform_mutex_unlock(&logger.drain_mutex);
+    return 1;
+}
+
+void log_set_level(Log_Level level) {
+    atomic_store_u32(&logger.level, level);
+}
+
+u64 log_get_dropped_count() {
+    u64 result = atomic_load_u64(&logger.shared_ring.dropped);
+    u32 ring_count = atomic_load_u32(&logger.ring_count);
+    for (u32 i = 0; i < ring_count; ++i) {
+        result += atomic_load_u64(&logger.rings[i]->dropped);
+    }
+    return result;
+}
+
+#endif
+
+#endif
@@ -1,4 +1,5 @@
 #import <Cocoa/Cocoa.h>
+#import <Carbon/Carbon.h> // kVK_* key codes
 
 @interface MacApp : NSWindow<NSApplicationDelegate>
 
@@ -9,6 +10,13 @@
 
 
 static MacApp *app;
+static Platform_State mac_platform_state;
+
+// The draw loop used to fire every microsecond and kept a core busy. One
+// tick per display refresh is all it can show anyway.
+#define MAC_FRAME_INTERVAL (1.0 / 60.0)
+
+#include "../posix/posix_platform.c"
 
 // VirtualAlloc equivalent on mac os with mmap taken from:
 // https://web.archive.org/web/20160104083454/http://blog.nervus.org/managing-virtual-address-spaces-with-mmap/
@@ -48,6 +56,9 @@ void platform_swap_buffers() {
 
 b32 platform_read_entire_file(char *file_name, Platform_File *result) {
     FILE *stream = fopen(file_name, "rb");
+    if (!stream) {
+        return 0;
+    }
 
     fseek(stream, 0, SEEK_END);
     result->size = ftell(stream);
@@ -62,23 +73,104 @@ b32 platform_read_entire_file(char *file_name, Platform_File *result) {
     return 1;
 }
 
+// =========================
+// >> Keys
+
+// Virtual key code -> Key, filled from key_list.inc.
+static Key mac_key_table[128];
+
+static void mac_init_key_table() {
+    for (s32 i = 0; i < ArrayCount(mac_key_table); ++i) {
+        mac_key_table[i] = KEY_UNKNOWN;
+    }
+#define Key(name, str, win32, mac, x11) if ((mac) >= 0) mac_key_table[(mac)] = KEY_##name;
+#include "../key_list.inc"
+#undef Key
+    // key_list.inc only has the left one of each modifier.
+    mac_key_table[kVK_RightShift]   = KEY_SHIFT;
+    mac_key_table[kVK_RightControl] = KEY_CTRL;
+    mac_key_table[kVK_RightOption]  = KEY_ALT;
+}
+
+static Key mac_translate_key(u16 key_code) {
+    return key_code < ArrayCount(mac_key_table) ? mac_key_table[key_code] : KEY_UNKNOWN;
+}
+
+// Every held modifier counts, Ctrl+Shift is both bits.
+static Key_Modifiers mac_get_modifiers(NSEventModifierFlags flags) {
+    Key_Modifiers key_modifiers = 0;
+    if (flags & NSEventModifierFlagControl) key_modifiers |= KEY_MODIFIER_CTRL;
+    if (flags & NSEventModifierFlagShift)   key_modifiers |= KEY_MODIFIER_SHIFT;
+    if (flags & NSEventModifierFlagOption)  key_modifiers |= KEY_MODIFIER_ALT;
+    return key_modifiers;
+}
+
+static void mac_push_key(Key key, b32 is_down, Key_Modifiers held) {
+    if (key == KEY_UNKNOWN) return;
+    Platform_Event event = {0};
+    {
+        event.type          = is_down ? Platform_Event_Type_Key_Press : Platform_Event_Type_Key_Release;
+        event.key           = key;
+        event.key_modifiers = key_event_modifiers(key, held);
+    }
+    platform_push_event(event);
+}
+
+static void mac_push_characters(NSEvent *ns_event, Key_Modifiers held) {
+    const char *text = [[ns_event characters] UTF8String];
+    if (!text) return;
+    u64 size = strlen(text);
+    for (u64 at = 0; at < size;) {
+        Unicode_Decode decode = str_utf8_decode((u8 *)text + at, size - at);
+        at += decode.advance ? decode.advance : 1;
+        // Arrows and function keys come as characters in 0xF700-0xF8FF.
+        u32 codepoint = decode.codepoint;
+        if (codepoint < 32 || codepoint == 127 || (codepoint >= 0xF700 && codepoint <= 0xF8FF)) continue;
+
+        Platform_Event event = {0};
+        {
+            event.type          = Platform_Event_Type_Character_Input;
+            event.character     = codepoint;
+            event.key_modifiers = held;
+        }
+        platform_push_event(event);
+    }
+}
+
 void init() {
+    mac_init_key_table();
+    platform_state = &mac_platform_state;
+    platform_state->window_width  = PLATFORM_DEFAULT_WINDOW_WIDTH;
+    platform_state->window_height = PLATFORM_DEFAULT_WINDOW_HEIGHT;
+    platform_state->running       = 1;
+    platform_event_queue_init(&platform_state->events);
+
+    app_init();
 }
 
-void update() {
+static void mac_update_viewport(s32 *width, s32 *height) {
+    NSRect bounds = [[app glView] bounds];
+    s32 window_width  = (s32)bounds.size.width;
+    s32 window_height = (s32)bounds.size.height;
+    if (window_width != *width || window_height != *height) {
+        *width  = window_width;
+        *height = window_height;
+        platform_state->window_width  = window_width;
+        platform_state->window_height = window_height;
+        glViewport(0, 0, window_width, window_height);
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(0.0f, (f32)window_width, (f32)window_height, 0.0f, 0.0f, 1.0f);
+    }
+}
 
-    glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
-    glLoadIdentity();
-    glClear(GL_COLOR_BUFFER_BIT);
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glBegin(GL_TRIANGLES);
-    glVertex3f(0.5f, 0.5f, 0.0f);
-    glVertex3f(0.5f, 0.0f, 0.0f);
-    glVertex3f(-0.5f, 0.0f, 0.0f);
-    glEnd();
-    glFlush();
+void update() {
+    static s32 viewport_width  = 0;
+    static s32 viewport_height = 0;
+    platform_begin_frame_time(0);
+    mac_update_viewport(&viewport_width, &viewport_height);
 
-    platform_swap_buffers();
+    app_update();
 }
 
 @implementation MacApp
@@ -91,8 +183,10 @@ BOOL shouldStop = NO;
     if (self = [super initWithContentRect:contentRect styleMask:aStyle backing:bufferingType defer:flag]) {
         [self setTitle:[[NSProcessInfo processInfo] processName]];
 
+        // The app draws with the fixed function pipeline, which the core
+        // profile does not have.
         NSOpenGLPixelFormatAttribute pixelFormatAttributes[] = {
-            NSOpenGLPFAOpenGLProfile, NSOpenGLProfileVersion3_2Core,
+            NSOpenGLPFAOpenGLProfile, NSOpenGLProfileVersionLegacy,
                 NSOpenGLPFAColorSize, 24,
                 NSOpenGLPFAAlphaSize, 8,
                 NSOpenGLPFADoubleBuffer,
@@ -118,12 +212,30 @@ BOOL shouldStop = NO;
     return self;
 }
 
+- (void)keyDown:(NSEvent *)event {
+    Key_Modifiers held = mac_get_modifiers([event modifierFlags]);
+    mac_push_key(mac_translate_key([event keyCode]), 1, held);
+    mac_push_characters(event, held);
+}
+
+- (void)keyUp:(NSEvent *)event {
+    mac_push_key(mac_translate_key([event keyCode]), 0, mac_get_modifiers([event modifierFlags]));
+}
+
+// Modifier keys only show up here, down while their flag is set.
+- (void)flagsChanged:(NSEvent *)event {
+    Key key = mac_translate_key([event keyCode]);
+    Key_Modifiers held = mac_get_modifiers([event modifierFlags]);
+    Key_Modifiers modifier = key_get_modifier(key);
+    if (modifier) mac_push_key(key, (held & modifier) != 0, held);
+}
+
 - (void)windowWillClose:(NSNotification *)notification {
     [NSApp terminate:self];
 }
 
 - (void)drawLoop:(NSTimer *)timer {
-    if (shouldStop) {
+    if (shouldStop || !atomic_load_u32(&platform_state->running)) {
         [self close];
         return;
     }
@@ -133,7 +245,7 @@ BOOL shouldStop = NO;
 }
 
 - (void)applicationDidFinishLaunching:(NSNotification *)notification {
-    [NSTimer scheduledTimerWithTimeInterval:0.000001 target:self selector:@selector(drawLoop:) userInfo:nil repeats:YES];
+    [NSTimer scheduledTimerWithTimeInterval:MAC_FRAME_INTERVAL target:self selector:@selector(drawLoop:) userInfo:nil repeats:YES];
 }
 
 - (BOOL)applicationShouldTerminateAfterLastWindowClosed:(NSApplication     *)theApplication{
@@ -142,6 +254,7 @@ BOOL shouldStop = NO;
 
 - (void)applicationWillTerminate:(NSNotification *)aNotification{
     shouldStop = YES;
+    app_shutdown();
 }
 
 @end
@@ -151,7 +264,7 @@ int main(int argc, char **argv) {
         NSApplication *application = [NSApplication sharedApplication];
         [NSApp setActivationPolicy:NSApplicationActivationPolicyRegular];
 
-        app = [[MacApp alloc] initWithContentRect:NSMakeRect(200, 200, 600, 600) styleMask:NSWindowStyleMaskTitled|NSWindowStyleMaskMiniaturizable|NSWindowStyleMaskClosable|NSWindowStyleMaskResizable backing:NSBackingStoreBuffered defer:YES];
+        app = [[MacApp alloc] initWithContentRect:NSMakeRect(200, 200, PLATFORM_DEFAULT_WINDOW_WIDTH, PLATFORM_DEFAULT_WINDOW_HEIGHT) styleMask:NSWindowStyleMaskTitled|NSWindowStyleMaskMiniaturizable|NSWindowStyleMaskClosable|NSWindowStyleMaskResizable backing:NSBackingStoreBuffered defer:YES];
 
         [application setDelegate:app];
         [application run];
@@ -48,6 +48,11 @@ GL_PROC_LIST
 #elif defined(BUILD_MACOS)
 #include <OpenGL/gl.h>
 #include <OpenGL/glext.h>
+
+#elif defined(__linux__)
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
 #endif
 
 void load_gl_functions() {
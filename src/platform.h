@@ -26,8 +26,13 @@
 #define PLATFORM_DEFAULT_WINDOW_WIDTH  1280
 #define PLATFORM_DEFAULT_WINDOW_HEIGHT 720
 
+#include "key_input.h"
 
-#define PLATFORM_MAX_EVENTS 1024
+// Capacity of the event queue, must be a power of two.
+#define PLATFORM_MAX_EVENTS 4096
+// How long a producer waits for the consumer when the queue is full
+// before the event is dropped.
+#define PLATFORM_EVENT_QUEUE_BLOCK_MS 100
 
 typedef enum Platform_Event_Type Platform_Event_Type;
 enum Platform_Event_Type {
@@ -43,9 +48,6 @@ enum Platform_Event_Type {
     Platform_Event_Type_Cursor_Enter
 };
 
-typedef s32 Key_Modifiers;
-typedef s32 Key;
-
 typedef struct Platform_Event Platform_Event;
 struct Platform_Event {
     Platform_Event_Type type;
@@ -54,6 +56,7 @@ struct Platform_Event {
     u32 character;
     ivec2 mouse_pos;
     s32 scroll_delta;
+    u64 time_ns; // platform_get_time_ns when it happened, set on push if 0.
 };
 
 typedef struct Platform_File Platform_File;
@@ -62,14 +65,317 @@ struct Platform_File {
     u8 *data;
 };
 
+// Access hints for platform_map_file. They only affect how the OS pages
+// the file in, the mapping is always read-only.
+typedef u32 Platform_Map_Flags;
+enum Platform_Map_Flags {
+    Platform_Map_Flag_Sequential = (1 << 0),
+    Platform_Map_Flag_Will_Need  = (1 << 1)
+};
+
+typedef u32 Platform_File_Flags;
+enum Platform_File_Flags {
+    Platform_File_Flag_Read     = (1 << 0),
+    Platform_File_Flag_Write    = (1 << 1),
+    Platform_File_Flag_Create   = (1 << 2),
+    Platform_File_Flag_Truncate = (1 << 3)
+};
+
+// Holds a file descriptor or a HANDLE. Invalid handles have the value
+// PLATFORM_INVALID_FILE_HANDLE.
+#define PLATFORM_INVALID_FILE_HANDLE 0xFFFFFFFFFFFFFFFFull
+
+// Offsets of writable views from platform_map_file_view have to be a
+// multiple of this (the allocation granularity on Windows).
+#define PLATFORM_MAP_VIEW_ALIGNMENT KB(64)
+
+typedef struct Platform_File_Handle Platform_File_Handle;
+struct Platform_File_Handle {
+    u64 value;
+};
+
+// A named region other processes can map, shm_open on posix and a
+// mapping backed by the page file on Windows. The names are plain
+// identifiers, the platform layer adds the prefix the OS wants. The
+// region lives until the process that created it closes it.
+#define PLATFORM_SHARED_MEMORY_NAME_SIZE 64
+
+typedef struct Platform_Shared_Memory Platform_Shared_Memory;
+struct Platform_Shared_Memory {
+    void *data;
+    u64 size;
+    b32 owner;
+    char name[PLATFORM_SHARED_MEMORY_NAME_SIZE]; // With the prefix.
+};
+
+// =========================
+// >> Asynchronous I/O
+//
+// The caller owns the Platform_Async_IO and the buffer (typically arena
+// memory), and both have to stay alive until the request completes.
+// Completion callbacks never run on a background thread; they run inside
+// platform_async_io_poll (or _wait) on the thread that calls it, which for
+// the app is once per frame in app_update.
+
+typedef enum Platform_Async_IO_Op Platform_Async_IO_Op;
+enum Platform_Async_IO_Op {
+    Platform_Async_IO_Op_Read,
+    Platform_Async_IO_Op_Write
+};
+
+typedef enum Platform_Async_IO_State Platform_Async_IO_State;
+enum Platform_Async_IO_State {
+    Platform_Async_IO_State_None,
+    Platform_Async_IO_State_Pending,
+    Platform_Async_IO_State_Done,
+    Platform_Async_IO_State_Failed
+};
+
+typedef struct Platform_Async_IO Platform_Async_IO;
+typedef void Platform_Async_IO_Callback(Platform_Async_IO *io);
+
+struct Platform_Async_IO {
+    Platform_Async_IO_Op op;
+    Platform_File_Handle file;
+    u64 offset;
+    u8 *buffer;
+    u64 size;
+    Platform_Async_IO_Callback *callback;
+    void *user_data;
+
+    // Written by the platform layer. A read that hits the end of the file
+    // is Done with bytes_transferred < size.
+    volatile Platform_Async_IO_State state;
+    u64 bytes_transferred;
+
+    // Backend bookkeeping (OVERLAPPED, iovec, queue links).
+    Platform_Async_IO *next;
+    u64 backend[6];
+};
+
+// =========================
+// >> Threads and synchronization
+//
+// Mutexes, condition variables, semaphores and events are plain words that
+// are only handed to the OS (futex, WaitOnAddress, __ulock) when a thread
+// actually has to sleep, so they need no initialization besides zeroing
+// and never allocate.
+
+typedef void Platform_Thread_Proc(void *data);
+
+// Called on the crashing thread before the process goes down.
+typedef void Platform_Crash_Proc();
+
+typedef struct Platform_Thread Platform_Thread;
+struct Platform_Thread {
+    u64 handle;
+};
+
+typedef struct Platform_Mutex Platform_Mutex;
+struct Platform_Mutex {
+    volatile u32 state; // 0: unlocked, 1: locked, 2: locked with waiters
+};
+
+typedef struct Platform_Condition_Variable Platform_Condition_Variable;
+struct Platform_Condition_Variable {
+    volatile u32 sequence;
+};
+
+typedef struct Platform_Semaphore Platform_Semaphore;
+struct Platform_Semaphore {
+    volatile u32 count;
+    volatile u32 waiters;
+};
+
+// Manual reset event: stays signaled until it is reset.
+typedef struct Platform_Thread_Event Platform_Thread_Event;
+struct Platform_Thread_Event {
+    volatile u32 signaled;
+};
+
+#define PLATFORM_MUTEX_SPIN_COUNT 64
+
+// =========================
+// >> Fibers
+//
+// Bare context switching, scheduling is up to the caller (see fibers.h).
+// The proc of a fiber must never return, it switches away when done.
+
+typedef void Platform_Fiber_Proc(void *data);
+
+typedef struct Platform_Fiber Platform_Fiber;
+struct Platform_Fiber {
+    void *context; // Saved stack pointer on POSIX, the fiber handle on Windows.
+    void *stack;
+    u64 stack_size;
+    Platform_Fiber_Proc *proc;
+    void *data;
+    b32 is_thread;
+    b32 converted_thread; // Windows: the thread was turned into a fiber for this.
+};
+
+// =========================
+// >> Event queue
+//
+// Bounded multi-producer single-consumer ring (Vyukov). Every slot has
+// a sequence number that says whether it is free for the producer with
+// the matching head or holds an event for the consumer with the matching
+// tail, so neither side takes a lock. The OS message pump may run on a
+// thread of its own while app_update consumes.
+//
+// When the queue is full, a producer on another thread than the consumer
+// waits up to PLATFORM_EVENT_QUEUE_BLOCK_MS for space. Only after that,
+// or when the consumer itself pushes, events are dropped and counted.
+//
+// Mouse moves and scrolls are coalesced before they reach the ring: the
+// latest position and the summed scroll delta wait in a pending slot
+// until another kind of event is pushed, which flushes them first so the
+// order is kept, or until the consumer runs out of events. However fast
+// the mouse reports, the consumer sees at most one move and one scroll
+// between two other events. Tools that want every raw sample turn this
+// off with platform_set_raw_mouse_events.
+//
+// While an input replay runs, platform_set_live_events turns live input
+// off: platform_push_event drops everything and only events pushed with
+// platform_push_replayed_event reach the ring and the input snapshot.
+
+typedef u32 Platform_Event_Pending;
+enum Platform_Event_Pending {
+    Platform_Event_Pending_Move   = (1 << 0),
+    Platform_Event_Pending_Scroll = (1 << 1)
+};
+
+typedef struct Platform_Event_Slot Platform_Event_Slot;
+struct Platform_Event_Slot {
+    volatile u64 sequence;
+    Platform_Event event;
+};
+
+typedef struct Platform_Event_Queue Platform_Event_Queue;
+struct Platform_Event_Queue {
+    volatile u64 head;
+    u8 pad0[56];
+    volatile u64 tail;
+    volatile u32 consumer_thread_id;
+    volatile u32 waiting_producers;
+    volatile u32 space_signal;
+    u8 pad1[44];
+
+    Platform_Mutex pending_mutex;
+    volatile u32 pending; // Platform_Event_Pending_* flags.
+    volatile u32 raw_mouse_events;
+    volatile u32 live_events_off;
+    u32 pending_first; // The Platform_Event_Pending_* flag that was set first.
+    Platform_Event pending_move;
+    Platform_Event pending_scroll;
+
+    // Statistics, only ever grow.
+    volatile u64 coalesced;
+    volatile u64 pushed;
+    volatile u64 dropped;
+    volatile u64 blocked; // Pushes that had to wait for the consumer.
+    volatile u64 max_depth;
+
+    Platform_Event_Slot slots[PLATFORM_MAX_EVENTS];
+};
+
+// =========================
+// >> Input snapshot
+//
+// Key and mouse state for polling, so code that asks about many keys per
+// frame does not have to walk the events. platform_push_event keeps
+// `input_live` up to date with atomic operations, so any thread may push.
+// platform_input_begin_frame copies it into `input` at the start of a
+// frame, which then stays the same until the next one. pressed, released
+// and scroll_delta collect everything since the previous frame, a key
+// that went down and up in between is pressed and released but not down.
+// Mouse buttons are keys as well.
+
+#define PLATFORM_KEY_WORDS ((KEY_MAX + 63) / 64)
+
+typedef struct Platform_Input Platform_Input;
+struct Platform_Input {
+    volatile u64 down[PLATFORM_KEY_WORDS];
+    volatile u64 pressed[PLATFORM_KEY_WORDS];
+    volatile u64 released[PLATFORM_KEY_WORDS];
+    ivec2 mouse_pos;
+    volatile s32 scroll_delta;
+    volatile Key_Modifiers modifiers;
+    volatile b32 mouse_inside;
+};
+
+// =========================
+// >> Time
+//
+// platform_get_time_ns is the monotonic clock everything is measured
+// with. cpu_cycle_counter is much cheaper to read but ticks at a rate
+// that differs per machine, platform_get_cycles_per_ns measures it
+// against the clock, spinning PLATFORM_CYCLE_CALIBRATION_NS on the first
+// call. platform_calibrate_cycle_counter measures again over all the
+// time since then, the backends do that about once a second.
+//
+// The backends call platform_begin_frame_time at the start of every
+// frame, it sets time_ns, delta_ns and delta in platform_state. delta is
+// only the frame's delta in seconds, anything that adds up time over
+// many frames should add up delta_ns.
+
+#define PLATFORM_CYCLE_CALIBRATION_NS 2000000
+#define PLATFORM_CALIBRATION_INTERVAL_NS 1000000000ull
+
+typedef struct Platform_Cycle_Clock Platform_Cycle_Clock;
+struct Platform_Cycle_Clock {
+    Platform_Mutex mutex;
+    u64 base_cycles;
+    u64 base_ns;
+    u64 calibrated_ns;
+    volatile u64 rate_bits; // The f64 cycles per ns, 0 until calibrated.
+};
+
+// =========================
+// >> Frame pacing
+//
+// In Platform_Frame_Mode_Continuous the backend runs frames back to back,
+// only held back by vsync and target_fps. In Platform_Frame_Mode_On_Demand
+// platform_wait_for_frame blocks the main loop until an event is pushed
+// or some code, on any thread, calls platform_request_frame. Whatever
+// animates or waits for work has to request the next frame itself, an
+// idle app then uses no CPU at all.
+//
+// With a target_fps the rest of each frame is slept away. OS sleeps wake
+// up late by up to a scheduler tick, so the sleep ends
+// PLATFORM_SLEEP_SPIN_NS early and the remainder is spun.
+
+#define PLATFORM_SLEEP_SPIN_NS 1000000
+
+typedef enum Platform_Frame_Mode Platform_Frame_Mode;
+enum Platform_Frame_Mode {
+    Platform_Frame_Mode_Continuous,
+    Platform_Frame_Mode_On_Demand
+};
+
+typedef struct Platform_Frame_Pacing Platform_Frame_Pacing;
+struct Platform_Frame_Pacing {
+    volatile u32 mode; // Platform_Frame_Mode
+    volatile u32 target_fps; // 0 means no limit.
+    volatile u32 requested;
+    volatile u32 wake; // Futex word, bumped by requests and pushed events.
+    volatile u32 waiting;
+    u64 frame_start_ns;
+    u64 idle_waits;
+};
+
 typedef struct Platform_State Platform_State;
 struct Platform_State {
     s32 window_width;
     s32 window_height;
     b32 running;
-    f32 delta;
-    u32 event_count;
-    Platform_Event *events;
+    u64 time_ns;  // Start of the current frame.
+    u64 delta_ns; // Since the start of the previous frame, 0 after idling.
+    f32 delta;    // delta_ns in seconds.
+    Platform_Input input;
+    Platform_Input input_live;
+    Platform_Event_Queue events;
+    Platform_Frame_Pacing pacing;
 };
 
 
@@ -81,14 +387,168 @@ static Platform_State *platform_state = 0;
 
 void platform_log(char *format, ...);
 b32 platform_read_entire_file(char *file_name, Platform_File *result);
+b32 platform_map_file(char *file_name, Platform_Map_Flags flags, String *result);
+void platform_unmap_file(String mapping);
+Platform_File_Handle platform_open_file(char *file_name, Platform_File_Flags flags);
+void platform_close_file(Platform_File_Handle file);
+u64 platform_get_file_size(Platform_File_Handle file);
+b32 platform_flush_file(Platform_File_Handle file);
+b32 platform_rename_file(char *old_name, char *new_name);
+b32 platform_delete_file(char *file_name);
+b32 platform_file_handle_is_valid(Platform_File_Handle file);
+b32 platform_set_file_size(Platform_File_Handle file, u64 size);
+void *platform_map_file_view(Platform_File_Handle file, u64 offset, u64 size);
+void platform_unmap_file_view(void *view, u64 size);
+b32 platform_write_file_gather(Platform_File_Handle file, u64 offset, String *buffers, u32 count);
+b32 platform_create_shared_memory(char *name, u64 size, Platform_Shared_Memory *result);
+b32 platform_open_shared_memory(char *name, Platform_Shared_Memory *result);
+void platform_close_shared_memory(Platform_Shared_Memory *memory);
+void platform_async_io_submit(Platform_Async_IO *io);
+u32 platform_async_io_poll();
+void platform_async_io_wait(Platform_Async_IO *io);
 void *platform_reserve_memory(u64 size);
 void platform_commit_memory(void *mem, u64 size);
 void platform_release_memory(void *mem, u64 size);
 void platform_decommit(void *mem, u64 size);
 void platform_swap_buffers();
 void *platform_get_gl_proc_address(char *function_name);
+u64 platform_get_time_ns();
+void platform_sleep_ns(u64 duration);
+void platform_sleep_until_ns(u64 time);
+f64 platform_get_cycles_per_ns();
+u64 platform_cycles_to_ns(u64 cycles);
+void platform_calibrate_cycle_counter();
+void platform_begin_frame_time(b32 idled);
+
+void platform_event_queue_init(Platform_Event_Queue *queue);
+b32 platform_push_event(Platform_Event event);
+b32 platform_push_replayed_event(Platform_Event event);
+void platform_set_live_events(b32 enabled);
+b32 platform_next_event(Platform_Event *event);
+void platform_set_raw_mouse_events(b32 enabled);
+u64 platform_event_queue_depth();
+void platform_input_begin_frame();
+b32 platform_key_is_down(Key key);
+b32 platform_key_was_pressed(Key key);
+b32 platform_key_was_released(Key key);
+
+void platform_set_frame_mode(Platform_Frame_Mode mode);
+void platform_set_target_fps(u32 fps);
+void platform_request_frame();
+b32 platform_wait_for_frame();
+
+Platform_Thread platform_thread_create(Platform_Thread_Proc *proc, void *data, char *name);
+void platform_thread_join(Platform_Thread thread);
+void platform_thread_set_affinity(Platform_Thread thread, u32 core);
+u32 platform_get_thread_id();
+u32 platform_get_core_count();
+void platform_thread_yield();
+void platform_set_crash_handler(Platform_Crash_Proc *proc);
+void platform_futex_wait(volatile u32 *address, u32 expected);
+b32 platform_futex_wait_timeout(volatile u32 *address, u32 expected, u32 timeout_ms);
+void platform_futex_wake(volatile u32 *address, b32 wake_all);
 
-void platform_push_event(Platform_Event event);
+b32 platform_fiber_init(Platform_Fiber *fiber, Platform_Fiber_Proc *proc, void *data, u64 stack_size);
+void platform_fiber_init_from_thread(Platform_Fiber *fiber);
+void platform_fiber_release(Platform_Fiber *fiber);
+void platform_fiber_switch(Platform_Fiber *from, Platform_Fiber *to);
+
+void platform_mutex_lock(Platform_Mutex *mutex);
+b32 platform_mutex_try_lock(Platform_Mutex *mutex);
+void platform_mutex_unlock(Platform_Mutex *mutex);
+void platform_condition_variable_wait(Platform_Condition_Variable *cv, Platform_Mutex *mutex);
+void platform_condition_variable_signal(Platform_Condition_Variable *cv);
+void platform_condition_variable_broadcast(Platform_Condition_Variable *cv);
+void platform_semaphore_wait(Platform_Semaphore *semaphore);
+b32 platform_semaphore_try_wait(Platform_Semaphore *semaphore);
+void platform_semaphore_post(Platform_Semaphore *semaphore, u32 count);
+void platform_thread_event_wait(Platform_Thread_Event *event);
+void platform_thread_event_set(Platform_Thread_Event *event);
+void platform_thread_event_reset(Platform_Thread_Event *event);
+
+
+// +===============+
+// | HELPER MACROS |
+// +===============+
+
+// cpu_cycle_counter reads the TSC on x86 and the virtual counter on
+// ARM. Both tick at a constant rate, but which one differs per machine.
+//
+// Atomics with the semantics of C11's memory_order_seq_cst. Every
+// read-modify-write returns the previous value, compare_exchange returns
+// the value that was found (the exchange happened if it equals expected).
+#if defined(_MSC_VER)
+#define atomic_load_u32(p)                     (*(volatile u32 *)(p))
+#define atomic_load_u64(p)                     (*(volatile u64 *)(p))
+#define atomic_load_ptr(p)                     (*(void * volatile *)(p))
+#define atomic_store_u32(p, v)                 ((void)_InterlockedExchange((volatile long *)(p), (long)(v)))
+#define atomic_store_u64(p, v)                 ((void)_InterlockedExchange64((volatile __int64 *)(p), (__int64)(v)))
+#define atomic_store_ptr(p, v)                 ((void)_InterlockedExchangePointer((void * volatile *)(p), (v)))
+#define atomic_fetch_add_u32(p, v)             ((u32)_InterlockedExchangeAdd((volatile long *)(p), (long)(v)))
+#define atomic_fetch_add_u64(p, v)             ((u64)_InterlockedExchangeAdd64((volatile __int64 *)(p), (__int64)(v)))
+#define atomic_fetch_or_u64(p, v)              ((u64)_InterlockedOr64((volatile __int64 *)(p), (__int64)(v)))
+#define atomic_fetch_and_u64(p, v)             ((u64)_InterlockedAnd64((volatile __int64 *)(p), (__int64)(v)))
+#define atomic_exchange_u32(p, v)              ((u32)_InterlockedExchange((volatile long *)(p), (long)(v)))
+#define atomic_exchange_u64(p, v)              ((u64)_InterlockedExchange64((volatile __int64 *)(p), (__int64)(v)))
+#define atomic_exchange_ptr(p, v)              _InterlockedExchangePointer((void * volatile *)(p), (v))
+#define atomic_compare_exchange_u32(p, e, v)   ((u32)_InterlockedCompareExchange((volatile long *)(p), (long)(v), (long)(e)))
+#define atomic_compare_exchange_u64(p, e, v)   ((u64)_InterlockedCompareExchange64((volatile __int64 *)(p), (__int64)(v), (__int64)(e)))
+#define atomic_compare_exchange_ptr(p, e, v)   _InterlockedCompareExchangePointer((void * volatile *)(p), (v), (e))
+#define atomic_thread_fence()                  MemoryBarrier()
+#define cpu_pause()                            _mm_pause()
+#define cpu_cycle_counter()                    ((u64)__rdtsc())
+#else
+#define atomic_load_u32(p)                     __atomic_load_n((volatile u32 *)(p), __ATOMIC_SEQ_CST)
+#define atomic_load_u64(p)                     __atomic_load_n((volatile u64 *)(p), __ATOMIC_SEQ_CST)
+#define atomic_load_ptr(p)                     __atomic_load_n((void * volatile *)(p), __ATOMIC_SEQ_CST)
+#define atomic_store_u32(p, v)                 __atomic_store_n((volatile u32 *)(p), (u32)(v), __ATOMIC_SEQ_CST)
+#define atomic_store_u64(p, v)                 __atomic_store_n((volatile u64 *)(p), (u64)(v), __ATOMIC_SEQ_CST)
+#define atomic_store_ptr(p, v)                 __atomic_store_n((void * volatile *)(p), (void *)(v), __ATOMIC_SEQ_CST)
+#define atomic_fetch_add_u32(p, v)             __atomic_fetch_add((volatile u32 *)(p), (u32)(v), __ATOMIC_SEQ_CST)
+#define atomic_fetch_add_u64(p, v)             __atomic_fetch_add((volatile u64 *)(p), (u64)(v), __ATOMIC_SEQ_CST)
+#define atomic_fetch_or_u64(p, v)              __atomic_fetch_or((volatile u64 *)(p), (u64)(v), __ATOMIC_SEQ_CST)
+#define atomic_fetch_and_u64(p, v)             __atomic_fetch_and((volatile u64 *)(p), (u64)(v), __ATOMIC_SEQ_CST)
+#define atomic_exchange_u32(p, v)              __atomic_exchange_n((volatile u32 *)(p), (u32)(v), __ATOMIC_SEQ_CST)
+#define atomic_exchange_u64(p, v)              __atomic_exchange_n((volatile u64 *)(p), (u64)(v), __ATOMIC_SEQ_CST)
+#define atomic_exchange_ptr(p, v)              __atomic_exchange_n((void * volatile *)(p), (void *)(v), __ATOMIC_SEQ_CST)
+#define atomic_compare_exchange_u32(p, e, v)   platform_atomic_cas_u32((volatile u32 *)(p), (u32)(e), (u32)(v))
+#define atomic_compare_exchange_u64(p, e, v)   platform_atomic_cas_u64((volatile u64 *)(p), (u64)(e), (u64)(v))
+#define atomic_compare_exchange_ptr(p, e, v)   platform_atomic_cas_ptr((void * volatile *)(p), (void *)(e), (void *)(v))
+#define atomic_thread_fence()                  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_pause()                            __builtin_ia32_pause()
+#define cpu_cycle_counter()                    ((u64)__builtin_ia32_rdtsc())
+#elif defined(__aarch64__)
+#define cpu_pause()                            __asm__ __volatile__("yield")
+#define cpu_cycle_counter()                    platform_read_virtual_counter()
+#else
+#define cpu_pause()
+#define cpu_cycle_counter()                    platform_get_time_ns()
+#endif
+
+#if defined(__aarch64__)
+static inline u64 platform_read_virtual_counter() {
+    u64 result;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(result));
+    return result;
+}
+#endif
+
+static inline u32 platform_atomic_cas_u32(volatile u32 *p, u32 expected, u32 desired) {
+    __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+}
+
+static inline u64 platform_atomic_cas_u64(volatile u64 *p, u64 expected, u64 desired) {
+    __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+}
+
+static inline void *platform_atomic_cas_ptr(void * volatile *p, void *expected, void *desired) {
+    __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+}
+#endif
 
 
 // +================+
@@ -97,11 +557,529 @@ void platform_push_event(Platform_Event event);
 
 #ifdef PLATFORM_IMPL
 
-void platform_push_event(Platform_Event event) {
-    if (platform_state->event_count < PLATFORM_MAX_EVENTS) {
-        platform_state->events[platform_state->event_count] = event;
-        platform_state->event_count += 1;
+b32 platform_file_handle_is_valid(Platform_File_Handle file) {
+    return file.value != PLATFORM_INVALID_FILE_HANDLE;
+}
+
+// =========================
+// >> Event queue
+
+void platform_event_queue_init(Platform_Event_Queue *queue) {
+    memset(queue, 0, sizeof(*queue));
+    for (u64 i = 0; i < PLATFORM_MAX_EVENTS; ++i) {
+        queue->slots[i].sequence = i;
+    }
+}
+
+static b32 platform_event_queue_push(Platform_Event_Queue *queue, Platform_Event event) {
+    for (;;) {
+        u64 head = atomic_load_u64(&queue->head);
+        Platform_Event_Slot *slot = &queue->slots[head & (PLATFORM_MAX_EVENTS - 1)];
+        s64 diff = (s64)(atomic_load_u64(&slot->sequence) - head);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_u64(&queue->head, head, head + 1) == head) {
+                slot->event = event;
+                atomic_store_u64(&slot->sequence, head + 1);
+                atomic_fetch_add_u64(&queue->pushed, 1);
+
+                u64 depth = head + 1 - atomic_load_u64(&queue->tail);
+                u64 max_depth = atomic_load_u64(&queue->max_depth);
+                while (depth > max_depth) {
+                    u64 found = atomic_compare_exchange_u64(&queue->max_depth, max_depth, depth);
+                    if (found == max_depth) break;
+                    max_depth = found;
+                }
+                return 1;
+            }
+        } else if (diff < 0) {
+            // Full. The consumer cannot make room while it is the one pushing.
+            u32 consumer = atomic_load_u32(&queue->consumer_thread_id);
+            if (!consumer || consumer == platform_get_thread_id()) {
+                atomic_fetch_add_u64(&queue->dropped, 1);
+                return 0;
+            }
+
+            atomic_fetch_add_u64(&queue->blocked, 1);
+            u32 signal = atomic_load_u32(&queue->space_signal);
+            atomic_fetch_add_u32(&queue->waiting_producers, 1);
+            b32 woken = 1;
+            if ((s64)(atomic_load_u64(&slot->sequence) - head) < 0) {
+                woken = platform_futex_wait_timeout(&queue->space_signal, signal, PLATFORM_EVENT_QUEUE_BLOCK_MS);
+            }
+            atomic_fetch_add_u32(&queue->waiting_producers, (u32)-1);
+            if (!woken) {
+                atomic_fetch_add_u64(&queue->dropped, 1);
+                return 0;
+            }
+        }
+        // Otherwise another producer took the slot first, try the next one.
+    }
+}
+
+// The events are copied out and pushed after the lock is let go, the
+// push may wait for space in the ring and other mouse producers should
+// not wait with it. They keep the order in which they arrived.
+static void platform_event_queue_flush_pending(Platform_Event_Queue *queue) {
+    Platform_Event events[2];
+    u32 count = 0;
+    platform_mutex_lock(&queue->pending_mutex);
+    u32 pending = queue->pending;
+    b32 scroll_first = queue->pending_first == Platform_Event_Pending_Scroll;
+    if ((pending & Platform_Event_Pending_Scroll) && scroll_first)  events[count++] = queue->pending_scroll;
+    if (pending & Platform_Event_Pending_Move)                      events[count++] = queue->pending_move;
+    if ((pending & Platform_Event_Pending_Scroll) && !scroll_first) events[count++] = queue->pending_scroll;
+    atomic_store_u32(&queue->pending, 0);
+    platform_mutex_unlock(&queue->pending_mutex);
+    for (u32 i = 0; i < count; ++i) {
+        platform_event_queue_push(queue, events[i]);
+    }
+}
+
+static void platform_input_apply(Platform_Input *input, Platform_Event *event) {
+    u32 word = (u32)event->key / 64;
+    u64 bit = 1ull << ((u32)event->key % 64);
+    b32 valid_key = event->key >= 0 && event->key < KEY_MAX;
+
+    switch (event->type) {
+        case Platform_Event_Type_Key_Press:
+        case Platform_Event_Type_Mouse_Press: {
+            if (!valid_key) break;
+            // Key repeats arrive as presses as well, they do not count.
+            if (!(atomic_fetch_or_u64(&input->down[word], bit) & bit)) {
+                atomic_fetch_or_u64(&input->pressed[word], bit);
+            }
+            atomic_store_u32(&input->modifiers, event->key_modifiers);
+        } break;
+
+        case Platform_Event_Type_Key_Release:
+        case Platform_Event_Type_Mouse_Release: {
+            if (!valid_key) break;
+            if (atomic_fetch_and_u64(&input->down[word], ~bit) & bit) {
+                atomic_fetch_or_u64(&input->released[word], bit);
+            }
+            atomic_store_u32(&input->modifiers, event->key_modifiers);
+        } break;
+
+        case Platform_Event_Type_Mouse_Move: {
+            atomic_store_u32(&input->mouse_pos.x, event->mouse_pos.x);
+            atomic_store_u32(&input->mouse_pos.y, event->mouse_pos.y);
+        } break;
+
+        case Platform_Event_Type_Mouse_Scroll: {
+            atomic_fetch_add_u32(&input->scroll_delta, event->scroll_delta);
+        } break;
+
+        case Platform_Event_Type_Cursor_Enter:
+        case Platform_Event_Type_Cursor_Leave: {
+            atomic_store_u32(&input->mouse_inside, event->type == Platform_Event_Type_Cursor_Enter);
+        } break;
+    }
+}
+
+static void platform_frame_wake() {
+    Platform_Frame_Pacing *pacing = &platform_state->pacing;
+    if (atomic_load_u32(&pacing->mode) != Platform_Frame_Mode_On_Demand) return;
+    atomic_fetch_add_u32(&pacing->wake, 1);
+    if (atomic_load_u32(&pacing->waiting)) {
+        platform_futex_wake(&pacing->wake, 1);
+    }
+}
+
+static b32 platform_event_queue_submit(Platform_Event_Queue *queue, Platform_Event event) {
+    if (!event.time_ns) event.time_ns = platform_get_time_ns();
+    platform_input_apply(&platform_state->input_live, &event);
+
+    b32 is_mouse = event.type == Platform_Event_Type_Mouse_Move || event.type == Platform_Event_Type_Mouse_Scroll;
+    if (is_mouse && !atomic_load_u32(&queue->raw_mouse_events)) {
+        platform_mutex_lock(&queue->pending_mutex);
+        if (!queue->pending) {
+            queue->pending_first = event.type == Platform_Event_Type_Mouse_Move ? Platform_Event_Pending_Move : Platform_Event_Pending_Scroll;
+        }
+        if (event.type == Platform_Event_Type_Mouse_Move) {
+            if (queue->pending & Platform_Event_Pending_Move) atomic_fetch_add_u64(&queue->coalesced, 1);
+            queue->pending_move = event;
+            atomic_store_u32(&queue->pending, queue->pending | Platform_Event_Pending_Move);
+        } else if (queue->pending & Platform_Event_Pending_Scroll) {
+            queue->pending_scroll.scroll_delta += event.scroll_delta;
+            queue->pending_scroll.time_ns = event.time_ns;
+            atomic_fetch_add_u64(&queue->coalesced, 1);
+        } else {
+            queue->pending_scroll = event;
+            atomic_store_u32(&queue->pending, queue->pending | Platform_Event_Pending_Scroll);
+        }
+        platform_mutex_unlock(&queue->pending_mutex);
+        platform_frame_wake();
+        return 1;
+    }
+
+    if (atomic_load_u32(&queue->pending)) {
+        platform_event_queue_flush_pending(queue);
+    }
+    b32 result = platform_event_queue_push(queue, event);
+    platform_frame_wake();
+    return result;
+}
+
+// Returns 0 when the queue stayed full and the event was dropped, or
+// when live events are turned off.
+b32 platform_push_event(Platform_Event event) {
+    Platform_Event_Queue *queue = &platform_state->events;
+    if (atomic_load_u32(&queue->live_events_off)) return 0;
+    return platform_event_queue_submit(queue, event);
+}
+
+// Pushes an event of an input replay, whether live events are on or not.
+b32 platform_push_replayed_event(Platform_Event event) {
+    return platform_event_queue_submit(&platform_state->events, event);
+}
+
+// Turning live events off also forgets the live key and mouse state, so
+// nothing that was held before leaks into the replayed frames. A push
+// that is already past the check may still land, the caller drains the
+// queue once after turning them off.
+void platform_set_live_events(b32 enabled) {
+    Platform_Event_Queue *queue = &platform_state->events;
+    atomic_store_u32(&queue->live_events_off, !enabled);
+    if (!enabled) {
+        Platform_Input *live = &platform_state->input_live;
+        for (u32 i = 0; i < PLATFORM_KEY_WORDS; ++i) {
+            atomic_store_u64(&live->down[i], 0);
+            atomic_store_u64(&live->pressed[i], 0);
+            atomic_store_u64(&live->released[i], 0);
+        }
+        atomic_store_u32(&live->mouse_pos.x, 0);
+        atomic_store_u32(&live->mouse_pos.y, 0);
+        atomic_store_u32(&live->scroll_delta, 0);
+        atomic_store_u32(&live->modifiers, 0);
+        atomic_store_u32(&live->mouse_inside, 0);
+    }
+}
+
+// Pending moves and scrolls are handed out once the ring is empty, the
+// older one first. If a producer holds the lock right now they simply
+// come with the next call.
+static b32 platform_event_queue_pop_pending(Platform_Event_Queue *queue, Platform_Event *event) {
+    if (!atomic_load_u32(&queue->pending)) return 0;
+    if (!platform_mutex_try_lock(&queue->pending_mutex)) return 0;
+
+    Platform_Event_Pending first = queue->pending_first;
+    if (!(queue->pending & first)) first = queue->pending;
+
+    b32 result = 1;
+    if (first & Platform_Event_Pending_Move) {
+        *event = queue->pending_move;
+        atomic_store_u32(&queue->pending, queue->pending & ~Platform_Event_Pending_Move);
+    } else if (first & Platform_Event_Pending_Scroll) {
+        *event = queue->pending_scroll;
+        atomic_store_u32(&queue->pending, queue->pending & ~Platform_Event_Pending_Scroll);
+    } else {
+        result = 0;
+    }
+    platform_mutex_unlock(&queue->pending_mutex);
+    return result;
+}
+
+// Pops the oldest event. Must only be called from one thread.
+b32 platform_next_event(Platform_Event *event) {
+    Platform_Event_Queue *queue = &platform_state->events;
+    if (!queue->consumer_thread_id) {
+        atomic_store_u32(&queue->consumer_thread_id, platform_get_thread_id());
+    }
+
+    u64 tail = queue->tail;
+    Platform_Event_Slot *slot = &queue->slots[tail & (PLATFORM_MAX_EVENTS - 1)];
+    if (atomic_load_u64(&slot->sequence) != tail + 1) {
+        return platform_event_queue_pop_pending(queue, event);
+    }
+
+    // tail moves before the slot is released, so a producer never sees
+    // more than PLATFORM_MAX_EVENTS queued.
+    *event = slot->event;
+    atomic_store_u64(&queue->tail, tail + 1);
+    atomic_store_u64(&slot->sequence, tail + PLATFORM_MAX_EVENTS);
+
+    if (atomic_load_u32(&queue->waiting_producers)) {
+        atomic_fetch_add_u32(&queue->space_signal, 1);
+        platform_futex_wake(&queue->space_signal, 1);
+    }
+    return 1;
+}
+
+// With raw mouse events on, every move and scroll goes through the ring
+// as it was reported.
+void platform_set_raw_mouse_events(b32 enabled) {
+    Platform_Event_Queue *queue = &platform_state->events;
+    if (!enabled) {
+        atomic_store_u32(&queue->raw_mouse_events, 0);
+    } else if (!atomic_exchange_u32(&queue->raw_mouse_events, 1) && atomic_load_u32(&queue->pending)) {
+        platform_event_queue_flush_pending(queue);
+    }
+}
+
+void platform_input_begin_frame() {
+    Platform_Input *live = &platform_state->input_live;
+    Platform_Input *input = &platform_state->input;
+    for (u32 i = 0; i < PLATFORM_KEY_WORDS; ++i) {
+        input->pressed[i]  = atomic_exchange_u64(&live->pressed[i], 0);
+        input->released[i] = atomic_exchange_u64(&live->released[i], 0);
+        input->down[i]     = atomic_load_u64(&live->down[i]);
+    }
+    input->mouse_pos.x  = (s32)atomic_load_u32(&live->mouse_pos.x);
+    input->mouse_pos.y  = (s32)atomic_load_u32(&live->mouse_pos.y);
+    input->scroll_delta = (s32)atomic_exchange_u32(&live->scroll_delta, 0);
+    input->modifiers    = (Key_Modifiers)atomic_load_u32(&live->modifiers);
+    input->mouse_inside = (b32)atomic_load_u32(&live->mouse_inside);
+}
+
+b32 platform_key_is_down(Key key) {
+    if (key < 0 || key >= KEY_MAX) return 0;
+    return (platform_state->input.down[key / 64] >> (key % 64)) & 1;
+}
+
+b32 platform_key_was_pressed(Key key) {
+    if (key < 0 || key >= KEY_MAX) return 0;
+    return (platform_state->input.pressed[key / 64] >> (key % 64)) & 1;
+}
+
+b32 platform_key_was_released(Key key) {
+    if (key < 0 || key >= KEY_MAX) return 0;
+    return (platform_state->input.released[key / 64] >> (key % 64)) & 1;
+}
+
+u64 platform_event_queue_depth() {
+    Platform_Event_Queue *queue = &platform_state->events;
+    u64 tail = atomic_load_u64(&queue->tail);
+    u64 head = atomic_load_u64(&queue->head);
+    return head - tail;
+}
+
+
+// =========================
+// >> Time
+
+static Platform_Cycle_Clock platform_cycle_clock;
+
+void platform_calibrate_cycle_counter() {
+    Platform_Cycle_Clock *clock = &platform_cycle_clock;
+    platform_mutex_lock(&clock->mutex);
+    if (!clock->base_ns) {
+        clock->base_cycles = cpu_cycle_counter();
+        clock->base_ns = platform_get_time_ns();
+        while (platform_get_time_ns() - clock->base_ns < PLATFORM_CYCLE_CALIBRATION_NS) {
+            cpu_pause();
+        }
+    }
+
+    u64 cycles = cpu_cycle_counter();
+    u64 ns = platform_get_time_ns();
+    f64 rate = 1.0;
+    if (ns > clock->base_ns && cycles > clock->base_cycles) {
+        rate = (f64)(cycles - clock->base_cycles) / (f64)(ns - clock->base_ns);
+    }
+    u64 bits;
+    memcpy(&bits, &rate, sizeof(bits));
+    atomic_store_u64(&clock->rate_bits, bits);
+    clock->calibrated_ns = ns;
+    platform_mutex_unlock(&clock->mutex);
+}
+
+f64 platform_get_cycles_per_ns() {
+    u64 bits = atomic_load_u64(&platform_cycle_clock.rate_bits);
+    if (!bits) {
+        platform_calibrate_cycle_counter();
+        bits = atomic_load_u64(&platform_cycle_clock.rate_bits);
+    }
+    f64 rate;
+    memcpy(&rate, &bits, sizeof(rate));
+    return rate;
+}
+
+u64 platform_cycles_to_ns(u64 cycles) {
+    return (u64)((f64)cycles / platform_get_cycles_per_ns());
+}
+
+// The OS sleep ends PLATFORM_SLEEP_SPIN_NS early, the rest is spun.
+void platform_sleep_until_ns(u64 time) {
+    u64 now = platform_get_time_ns();
+    if (now + PLATFORM_SLEEP_SPIN_NS < time) {
+        platform_sleep_ns(time - now - PLATFORM_SLEEP_SPIN_NS);
     }
+    while (platform_get_time_ns() < time) {
+        cpu_pause();
+    }
+}
+
+// Waiting for input is not part of any frame, so the first frame after
+// an idle wait gets a delta of 0.
+void platform_begin_frame_time(b32 idled) {
+    u64 now = platform_get_time_ns();
+    u64 last = platform_state->time_ns;
+    platform_state->delta_ns = (idled || !last) ? 0 : now - last;
+    platform_state->delta    = (f32)((f64)platform_state->delta_ns / 1000000000.0);
+    platform_state->time_ns  = now;
+
+    if (now - platform_cycle_clock.calibrated_ns >= PLATFORM_CALIBRATION_INTERVAL_NS) {
+        platform_calibrate_cycle_counter();
+    }
+}
+
+
+// =========================
+// >> Frame pacing
+
+void platform_set_frame_mode(Platform_Frame_Mode mode) {
+    atomic_store_u32(&platform_state->pacing.mode, mode);
+    platform_request_frame();
+}
+
+void platform_set_target_fps(u32 fps) {
+    atomic_store_u32(&platform_state->pacing.target_fps, fps);
+}
+
+// May be called from any thread.
+void platform_request_frame() {
+    Platform_Frame_Pacing *pacing = &platform_state->pacing;
+    atomic_store_u32(&pacing->requested, 1);
+    atomic_fetch_add_u32(&pacing->wake, 1);
+    if (atomic_load_u32(&pacing->waiting)) {
+        platform_futex_wake(&pacing->wake, 1);
+    }
+}
+
+static b32 platform_frame_is_due() {
+    Platform_Frame_Pacing *pacing = &platform_state->pacing;
+    if (atomic_load_u32(&pacing->mode) != Platform_Frame_Mode_On_Demand) return 1;
+    if (atomic_exchange_u32(&pacing->requested, 0)) return 1;
+    if (!atomic_load_u32(&platform_state->running)) return 1;
+    Platform_Event_Queue *queue = &platform_state->events;
+    return platform_event_queue_depth() > 0 || atomic_load_u32(&queue->pending);
+}
+
+// Called by the backend's main loop before every frame. Blocks while
+// there is nothing to do, then waits out the rest of the frame for
+// target_fps, then starts the frame's time. Returns 1 if it blocked.
+b32 platform_wait_for_frame() {
+    Platform_Frame_Pacing *pacing = &platform_state->pacing;
+    b32 idled = 0;
+    for (;;) {
+        u32 wake = atomic_load_u32(&pacing->wake);
+        if (platform_frame_is_due()) break;
+
+        // Any push or request after wake was read changes it, so the
+        // futex returns at once instead of missing it.
+        atomic_store_u32(&pacing->waiting, 1);
+        if (!platform_frame_is_due()) {
+            platform_futex_wait(&pacing->wake, wake);
+            idled = 1;
+        } else {
+            atomic_store_u32(&pacing->waiting, 0);
+            break;
+        }
+        atomic_store_u32(&pacing->waiting, 0);
+    }
+    if (idled) pacing->idle_waits += 1;
+
+    u32 target_fps = atomic_load_u32(&pacing->target_fps);
+    if (target_fps && !idled && pacing->frame_start_ns) {
+        platform_sleep_until_ns(pacing->frame_start_ns + 1000000000ull / target_fps);
+    }
+    platform_begin_frame_time(idled);
+    pacing->frame_start_ns = platform_state->time_ns;
+    return idled;
+}
+
+
+// =========================
+// >> Synchronization
+
+// Drepper, "Futexes Are Tricky", mutex take 3, with a short spin first
+// since most critical sections in here are tiny.
+void platform_mutex_lock(Platform_Mutex *mutex) {
+    for (u32 i = 0; i < PLATFORM_MUTEX_SPIN_COUNT; ++i) {
+        if (atomic_compare_exchange_u32(&mutex->state, 0, 1) == 0) return;
+        cpu_pause();
+    }
+
+    u32 state = atomic_compare_exchange_u32(&mutex->state, 0, 1);
+    if (state != 0) {
+        if (state != 2) state = atomic_exchange_u32(&mutex->state, 2);
+        while (state != 0) {
+            platform_futex_wait(&mutex->state, 2);
+            state = atomic_exchange_u32(&mutex->state, 2);
+        }
+    }
+}
+
+b32 platform_mutex_try_lock(Platform_Mutex *mutex) {
+    return atomic_compare_exchange_u32(&mutex->state, 0, 1) == 0;
+}
+
+void platform_mutex_unlock(Platform_Mutex *mutex) {
+    if (atomic_exchange_u32(&mutex->state, 0) == 2) {
+        platform_futex_wake(&mutex->state, 0);
+    }
+}
+
+void platform_condition_variable_wait(Platform_Condition_Variable *cv, Platform_Mutex *mutex) {
+    u32 sequence = atomic_load_u32(&cv->sequence);
+    platform_mutex_unlock(mutex);
+    platform_futex_wait(&cv->sequence, sequence);
+    // We cannot know whether others are waiting, so lock as contended.
+    while (atomic_exchange_u32(&mutex->state, 2) != 0) {
+        platform_futex_wait(&mutex->state, 2);
+    }
+}
+
+void platform_condition_variable_signal(Platform_Condition_Variable *cv) {
+    atomic_fetch_add_u32(&cv->sequence, 1);
+    platform_futex_wake(&cv->sequence, 0);
+}
+
+void platform_condition_variable_broadcast(Platform_Condition_Variable *cv) {
+    atomic_fetch_add_u32(&cv->sequence, 1);
+    platform_futex_wake(&cv->sequence, 1);
+}
+
+b32 platform_semaphore_try_wait(Platform_Semaphore *semaphore) {
+    u32 count = atomic_load_u32(&semaphore->count);
+    while (count > 0) {
+        u32 found = atomic_compare_exchange_u32(&semaphore->count, count, count - 1);
+        if (found == count) return 1;
+        count = found;
+    }
+    return 0;
+}
+
+void platform_semaphore_wait(Platform_Semaphore *semaphore) {
+    while (!platform_semaphore_try_wait(semaphore)) {
+        atomic_fetch_add_u32(&semaphore->waiters, 1);
+        platform_futex_wait(&semaphore->count, 0);
+        atomic_fetch_add_u32(&semaphore->waiters, (u32)-1);
+    }
+}
+
+void platform_semaphore_post(Platform_Semaphore *semaphore, u32 count) {
+    atomic_fetch_add_u32(&semaphore->count, count);
+    if (atomic_load_u32(&semaphore->waiters)) {
+        platform_futex_wake(&semaphore->count, count > 1);
+    }
+}
+
+void platform_thread_event_wait(Platform_Thread_Event *event) {
+    while (!atomic_load_u32(&event->signaled)) {
+        platform_futex_wait(&event->signaled, 0);
+    }
+}
+
+void platform_thread_event_set(Platform_Thread_Event *event) {
+    if (atomic_exchange_u32(&event->signaled, 1) == 0) {
+        platform_futex_wake(&event->signaled, 1);
+    }
+}
+
+void platform_thread_event_reset(Platform_Thread_Event *event) {
+    atomic_store_u32(&event->signaled, 0);
 }
 
 #endif
@@ -0,0 +1,894 @@
+// Platform functions shared by all POSIX backends (macOS, Linux).
+// Backend specific parts stay in the backend's own file.
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+b32 platform_map_file(char *file_name, Platform_Map_Flags flags, String *result) {
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        return 0;
+    }
+    result->size = (u64)file_stat.st_size;
+    result->str  = 0;
+
+    // Empty files cannot be mapped, but a view is not needed for them anyway.
+    if (result->size > 0 && S_ISREG(file_stat.st_mode)) {
+        void *mem = mmap(0, result->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mem != MAP_FAILED) {
+            result->str = (u8 *)mem;
+            if (flags & Platform_Map_Flag_Sequential) madvise(mem, result->size, MADV_SEQUENTIAL);
+            if (flags & Platform_Map_Flag_Will_Need)  madvise(mem, result->size, MADV_WILLNEED);
+        }
+    }
+    close(fd);
+
+    if (result->size > 0 && !result->str) {
+        Platform_File file;
+        if (!platform_read_entire_file(file_name, &file)) {
+            return 0;
+        }
+        result->str  = file.data;
+        result->size = file.size;
+    }
+    return 1;
+}
+
+void platform_unmap_file(String mapping) {
+    // The buffered fallback allocates with platform_reserve_memory, which
+    // is an mmap as well, so both cases are released the same way.
+    if (mapping.str) {
+        munmap(mapping.str, mapping.size);
+    }
+}
+
+
+// =========================
+// >> Files
+
+Platform_File_Handle platform_open_file(char *file_name, Platform_File_Flags flags) {
+    int open_flags = O_RDONLY;
+    if ((flags & Platform_File_Flag_Read) && (flags & Platform_File_Flag_Write)) {
+        open_flags = O_RDWR;
+    } else if (flags & Platform_File_Flag_Write) {
+        open_flags = O_WRONLY;
+    }
+    if (flags & Platform_File_Flag_Create)   open_flags |= O_CREAT;
+    if (flags & Platform_File_Flag_Truncate) open_flags |= O_TRUNC;
+
+    Platform_File_Handle result;
+    int fd = open(file_name, open_flags | O_CLOEXEC, 0644);
+    result.value = fd < 0 ? PLATFORM_INVALID_FILE_HANDLE : (u64)fd;
+    return result;
+}
+
+void platform_close_file(Platform_File_Handle file) {
+    if (platform_file_handle_is_valid(file)) {
+        close((int)file.value);
+    }
+}
+
+u64 platform_get_file_size(Platform_File_Handle file) {
+    struct stat file_stat;
+    if (fstat((int)file.value, &file_stat) != 0) {
+        return 0;
+    }
+    return (u64)file_stat.st_size;
+}
+
+b32 platform_flush_file(Platform_File_Handle file) {
+    return fsync((int)file.value) == 0;
+}
+
+// Replaces new_name atomically if it exists.
+b32 platform_rename_file(char *old_name, char *new_name) {
+    return rename(old_name, new_name) == 0;
+}
+
+b32 platform_delete_file(char *file_name) {
+    return unlink(file_name) == 0;
+}
+
+b32 platform_set_file_size(Platform_File_Handle file, u64 size) {
+    return ftruncate((int)file.value, (off_t)size) == 0;
+}
+
+// A read-write view of [offset, offset + size), the file grows to fit.
+// The file has to be opened for reading and writing.
+void *platform_map_file_view(Platform_File_Handle file, u64 offset, u64 size) {
+    if (platform_get_file_size(file) < offset + size && !platform_set_file_size(file, offset + size)) {
+        return 0;
+    }
+    void *view = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, (int)file.value, (off_t)offset);
+    return view == MAP_FAILED ? 0 : view;
+}
+
+void platform_unmap_file_view(void *view, u64 size) {
+    if (view) munmap(view, size);
+}
+
+// Writes the buffers back to back starting at offset, blocking until all
+// of them are written. Each pwritev takes up to 64 of them, short writes
+// continue where they stopped.
+b32 platform_write_file_gather(Platform_File_Handle file, u64 offset, String *buffers, u32 count) {
+    struct iovec vectors[64];
+    u32 index = 0;
+    u64 skip = 0; // Bytes of buffers[index] that are already written.
+    for (;;) {
+        while (index < count && buffers[index].size == skip) {
+            index += 1;
+            skip = 0;
+        }
+        if (index == count) return 1;
+
+        u32 vector_count = 0;
+        for (u32 i = index; i < count && vector_count < ArrayCount(vectors); ++i) {
+            u64 start = i == index ? skip : 0;
+            if (buffers[i].size == start) continue;
+            vectors[vector_count].iov_base = buffers[i].str + start;
+            vectors[vector_count].iov_len  = buffers[i].size - start;
+            vector_count += 1;
+        }
+
+        ssize_t written = pwritev((int)file.value, vectors, (int)vector_count, (off_t)offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return 0;
+
+        offset += (u64)written;
+        u64 left = (u64)written;
+        while (left > 0) {
+            u64 rest = buffers[index].size - skip;
+            if (left < rest) {
+                skip += left;
+                break;
+            }
+            left -= rest;
+            index += 1;
+            skip = 0;
+        }
+    }
+}
+
+
+// =========================
+// >> Shared memory
+
+// The region starts zeroed. One of the same name is replaced, it was
+// left behind by a process that crashed or belongs to one that will
+// not see it anymore.
+b32 platform_create_shared_memory(char *name, u64 size, Platform_Shared_Memory *result) {
+    memset(result, 0, sizeof(*result));
+    snprintf(result->name, sizeof(result->name), "/%s", name);
+    shm_unlink(result->name);
+    int fd = shm_open(result->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) return 0;
+
+    void *data = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        shm_unlink(result->name);
+        return 0;
+    }
+    result->data  = data;
+    result->size  = size;
+    result->owner = 1;
+    return 1;
+}
+
+// Maps a region of another process read-only, the size may be rounded
+// up to whole pages.
+b32 platform_open_shared_memory(char *name, Platform_Shared_Memory *result) {
+    memset(result, 0, sizeof(*result));
+    snprintf(result->name, sizeof(result->name), "/%s", name);
+    int fd = shm_open(result->name, O_RDONLY, 0);
+    if (fd < 0) return 0;
+
+    struct stat file_stat;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+        data = mmap(0, (u64)file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) return 0;
+    result->data = data;
+    result->size = (u64)file_stat.st_size;
+    return 1;
+}
+
+void platform_close_shared_memory(Platform_Shared_Memory *memory) {
+    if (memory->data) munmap(memory->data, memory->size);
+    if (memory->owner) shm_unlink(memory->name);
+    memset(memory, 0, sizeof(*memory));
+}
+
+
+// =========================
+// >> Asynchronous I/O
+//
+// On Linux requests go through io_uring. Where that is not available
+// (macOS, old kernels, sandboxes that block the syscalls) a small pool of
+// threads runs blocking preads/pwrites instead. Either way, finished
+// requests are collected in `completed` and their callbacks are run by
+// platform_async_io_poll on the polling thread.
+
+#include <pthread.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#define POSIX_ASYNC_IO_QUEUE_DEPTH 256
+#define POSIX_ASYNC_IO_NUM_WORKERS 4
+// Linux transfers at most 0x7ffff000 bytes per call.
+#define POSIX_ASYNC_IO_MAX_TRANSFER GB(1)
+
+typedef struct Posix_Async_IO_Queue Posix_Async_IO_Queue;
+struct Posix_Async_IO_Queue {
+    Platform_Async_IO *first;
+    Platform_Async_IO *last;
+};
+
+typedef struct Posix_Async_IO Posix_Async_IO;
+struct Posix_Async_IO {
+    pthread_mutex_t mutex;
+    pthread_cond_t work_available;
+    pthread_cond_t completed_available;
+    Posix_Async_IO_Queue work;
+    Posix_Async_IO_Queue completed;
+    pthread_t workers[POSIX_ASYNC_IO_NUM_WORKERS];
+
+#if defined(__linux__)
+    b32 use_io_uring;
+    int ring_fd;
+    u32 *sq_head;
+    u32 *sq_tail;
+    u32 *sq_array;
+    u32 sq_mask;
+    u32 sq_entries;
+    struct io_uring_sqe *sqes;
+    u32 *cq_head;
+    u32 *cq_tail;
+    u32 cq_mask;
+    struct io_uring_cqe *cqes;
+    u32 in_flight;
+    u32 unsubmitted;
+    // Requests that did not fit into the submission ring yet.
+    Posix_Async_IO_Queue backlog;
+#endif
+};
+
+static Posix_Async_IO global_posix_async_io;
+static pthread_once_t global_posix_async_io_once = PTHREAD_ONCE_INIT;
+
+// backend[0] holds the result until the request is dispatched, backend[1..2]
+// the iovec for io_uring.
+#define POSIX_ASYNC_IO_RESULT_OK     1
+#define POSIX_ASYNC_IO_RESULT_FAILED 2
+
+static void posix_async_io_queue_push(Posix_Async_IO_Queue *queue, Platform_Async_IO *io) {
+    io->next = 0;
+    Queue_PushBack(queue, io);
+}
+
+static Platform_Async_IO *posix_async_io_queue_pop(Posix_Async_IO_Queue *queue) {
+    Platform_Async_IO *result = queue->first;
+    if (result) {
+        Queue_PopFront(queue);
+        if (!queue->first) queue->last = 0;
+    }
+    return result;
+}
+
+// Must be called with the mutex held.
+static void posix_async_io_finish(Platform_Async_IO *io, b32 ok) {
+    io->backend[0] = ok ? POSIX_ASYNC_IO_RESULT_OK : POSIX_ASYNC_IO_RESULT_FAILED;
+    posix_async_io_queue_push(&global_posix_async_io.completed, io);
+    pthread_cond_broadcast(&global_posix_async_io.completed_available);
+}
+
+static void *posix_async_io_worker(void *param) {
+    Posix_Async_IO *async_io = &global_posix_async_io;
+    for (;;) {
+        pthread_mutex_lock(&async_io->mutex);
+        while (!async_io->work.first) {
+            pthread_cond_wait(&async_io->work_available, &async_io->mutex);
+        }
+        Platform_Async_IO *io = posix_async_io_queue_pop(&async_io->work);
+        pthread_mutex_unlock(&async_io->mutex);
+
+        b32 ok = 1;
+        int fd = (int)io->file.value;
+        while (io->bytes_transferred < io->size) {
+            u64 remaining = io->size - io->bytes_transferred;
+            u64 size = remaining < POSIX_ASYNC_IO_MAX_TRANSFER ? remaining : POSIX_ASYNC_IO_MAX_TRANSFER;
+            u8 *buffer = io->buffer + io->bytes_transferred;
+            off_t offset = (off_t)(io->offset + io->bytes_transferred);
+            ssize_t result = io->op == Platform_Async_IO_Op_Read ? pread(fd, buffer, size, offset) : pwrite(fd, buffer, size, offset);
+            if (result < 0 && errno == EINTR) continue;
+            if (result < 0 || (result == 0 && io->op == Platform_Async_IO_Op_Write)) {
+                ok = 0;
+                break;
+            }
+            if (result == 0) break; // end of file
+            io->bytes_transferred += (u64)result;
+        }
+
+        pthread_mutex_lock(&async_io->mutex);
+        posix_async_io_finish(io, ok);
+        pthread_mutex_unlock(&async_io->mutex);
+    }
+    return 0;
+}
+
+#if defined(__linux__)
+static b32 posix_io_uring_init(Posix_Async_IO *async_io) {
+    struct io_uring_params params = {0};
+    int fd = (int)syscall(__NR_io_uring_setup, POSIX_ASYNC_IO_QUEUE_DEPTH, &params);
+    if (fd < 0) {
+        return 0;
+    }
+
+    u64 sq_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+    u64 cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_size > sq_size) sq_size = cq_size;
+        cq_size = sq_size;
+    }
+
+    u8 *sq = (u8 *)mmap(0, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    u8 *cq = sq;
+    if (sq != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = (u8 *)mmap(0, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    }
+    struct io_uring_sqe *sqes = (struct io_uring_sqe *)mmap(0, params.sq_entries * sizeof(struct io_uring_sqe),
+                                                            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                                            fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+
+    async_io->ring_fd    = fd;
+    async_io->sq_head    = (u32 *)(sq + params.sq_off.head);
+    async_io->sq_tail    = (u32 *)(sq + params.sq_off.tail);
+    async_io->sq_array   = (u32 *)(sq + params.sq_off.array);
+    async_io->sq_mask    = *(u32 *)(sq + params.sq_off.ring_mask);
+    async_io->sq_entries = params.sq_entries;
+    async_io->sqes       = sqes;
+    async_io->cq_head    = (u32 *)(cq + params.cq_off.head);
+    async_io->cq_tail    = (u32 *)(cq + params.cq_off.tail);
+    async_io->cq_mask    = *(u32 *)(cq + params.cq_off.ring_mask);
+    async_io->cqes       = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 1;
+}
+
+// Puts the next transfer of io into the submission ring. Must be called
+// with the mutex held. Returns 0 if the ring is full.
+static b32 posix_io_uring_push(Posix_Async_IO *async_io, Platform_Async_IO *io) {
+    u32 tail = *async_io->sq_tail;
+    u32 head = __atomic_load_n(async_io->sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head >= async_io->sq_entries || async_io->in_flight >= async_io->sq_entries) {
+        return 0;
+    }
+
+    u64 remaining = io->size - io->bytes_transferred;
+    struct iovec *iov = (struct iovec *)&io->backend[1];
+    iov->iov_base = io->buffer + io->bytes_transferred;
+    iov->iov_len  = remaining < POSIX_ASYNC_IO_MAX_TRANSFER ? remaining : POSIX_ASYNC_IO_MAX_TRANSFER;
+
+    u32 index = tail & async_io->sq_mask;
+    struct io_uring_sqe *sqe = &async_io->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = io->op == Platform_Async_IO_Op_Read ? IORING_OP_READV : IORING_OP_WRITEV;
+    sqe->fd        = (s32)io->file.value;
+    sqe->addr      = (u64)iov;
+    sqe->len       = 1;
+    sqe->off       = io->offset + io->bytes_transferred;
+    sqe->user_data = (u64)io;
+    async_io->sq_array[index] = index;
+    __atomic_store_n(async_io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    async_io->in_flight   += 1;
+    async_io->unsubmitted += 1;
+    return 1;
+}
+
+// Moves the backlog into the ring and hands everything to the kernel.
+// Must be called with the mutex held.
+static void posix_io_uring_submit(Posix_Async_IO *async_io, u32 min_complete) {
+    while (async_io->backlog.first && posix_io_uring_push(async_io, async_io->backlog.first)) {
+        posix_async_io_queue_pop(&async_io->backlog);
+    }
+
+    u32 flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    if (async_io->unsubmitted || min_complete) {
+        s32 result = (s32)syscall(__NR_io_uring_enter, async_io->ring_fd, async_io->unsubmitted, min_complete, flags, 0, 0);
+        if (result > 0) {
+            async_io->unsubmitted -= (u32)result < async_io->unsubmitted ? (u32)result : async_io->unsubmitted;
+        }
+    }
+}
+
+// Moves finished transfers to `completed`, and puts partial ones back into
+// the queue. Must be called with the mutex held.
+static void posix_io_uring_reap(Posix_Async_IO *async_io) {
+    u32 head = *async_io->cq_head;
+    u32 tail = __atomic_load_n(async_io->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        struct io_uring_cqe *cqe = &async_io->cqes[head & async_io->cq_mask];
+        Platform_Async_IO *io = (Platform_Async_IO *)cqe->user_data;
+        s32 result = cqe->res;
+        async_io->in_flight -= 1;
+
+        if (result == -EINTR || result == -EAGAIN) {
+            posix_async_io_queue_push(&async_io->backlog, io);
+        } else if (result < 0 || (result == 0 && io->op == Platform_Async_IO_Op_Write)) {
+            posix_async_io_finish(io, 0);
+        } else {
+            io->bytes_transferred += (u64)result;
+            if (result == 0 || io->bytes_transferred >= io->size) {
+                posix_async_io_finish(io, 1);
+            } else {
+                posix_async_io_queue_push(&async_io->backlog, io);
+            }
+        }
+    }
+    __atomic_store_n(async_io->cq_head, head, __ATOMIC_RELEASE);
+}
+#endif
+
+static void posix_async_io_init() {
+    Posix_Async_IO *async_io = &global_posix_async_io;
+    pthread_mutex_init(&async_io->mutex, 0);
+    pthread_cond_init(&async_io->work_available, 0);
+    pthread_cond_init(&async_io->completed_available, 0);
+
+#if defined(__linux__)
+    async_io->use_io_uring = posix_io_uring_init(async_io);
+    if (async_io->use_io_uring) return;
+#endif
+
+    for (u32 i = 0; i < POSIX_ASYNC_IO_NUM_WORKERS; ++i) {
+        pthread_create(&async_io->workers[i], 0, posix_async_io_worker, 0);
+        pthread_detach(async_io->workers[i]);
+    }
+}
+
+void platform_async_io_submit(Platform_Async_IO *io) {
+    pthread_once(&global_posix_async_io_once, posix_async_io_init);
+    Posix_Async_IO *async_io = &global_posix_async_io;
+
+    io->state = Platform_Async_IO_State_Pending;
+    io->bytes_transferred = 0;
+    io->backend[0] = 0;
+
+    pthread_mutex_lock(&async_io->mutex);
+    if (io->size == 0) {
+        posix_async_io_finish(io, 1);
+    } else {
+#if defined(__linux__)
+        if (async_io->use_io_uring) {
+            posix_async_io_queue_push(&async_io->backlog, io);
+            posix_io_uring_submit(async_io, 0);
+            pthread_mutex_unlock(&async_io->mutex);
+            return;
+        }
+#endif
+        posix_async_io_queue_push(&async_io->work, io);
+        pthread_cond_signal(&async_io->work_available);
+    }
+    pthread_mutex_unlock(&async_io->mutex);
+}
+
+static u32 posix_async_io_process(b32 block) {
+    pthread_once(&global_posix_async_io_once, posix_async_io_init);
+    Posix_Async_IO *async_io = &global_posix_async_io;
+
+    b32 use_io_uring = 0;
+    pthread_mutex_lock(&async_io->mutex);
+#if defined(__linux__)
+    use_io_uring = async_io->use_io_uring;
+    if (use_io_uring) {
+        posix_io_uring_reap(async_io);
+        if (block && !async_io->completed.first && async_io->in_flight > 0) {
+            posix_io_uring_submit(async_io, 1);
+            posix_io_uring_reap(async_io);
+        }
+        // Partial transfers were put back into the backlog.
+        posix_io_uring_submit(async_io, 0);
+    }
+#endif
+    while (block && !use_io_uring && !async_io->completed.first) {
+        pthread_cond_wait(&async_io->completed_available, &async_io->mutex);
+    }
+    Posix_Async_IO_Queue completed = async_io->completed;
+    async_io->completed.first = 0;
+    async_io->completed.last  = 0;
+    pthread_mutex_unlock(&async_io->mutex);
+
+    // Callbacks run without the lock, so they can submit follow-up requests.
+    u32 count = 0;
+    for (Platform_Async_IO *io = completed.first; io;) {
+        Platform_Async_IO *next = io->next;
+        io->state = io->backend[0] == POSIX_ASYNC_IO_RESULT_OK ? Platform_Async_IO_State_Done : Platform_Async_IO_State_Failed;
+        if (io->callback) io->callback(io);
+        io = next;
+        count += 1;
+    }
+    return count;
+}
+
+u32 platform_async_io_poll() {
+    return posix_async_io_process(0);
+}
+
+void platform_async_io_wait(Platform_Async_IO *io) {
+    while (io->state == Platform_Async_IO_State_Pending) {
+        posix_async_io_process(1);
+    }
+}
+
+
+// =========================
+// >> Threads
+
+#include <sched.h>
+#include <signal.h>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+
+// The private wait-on-address interface libc++ uses for std::atomic::wait.
+#define POSIX_UL_COMPARE_AND_WAIT 1
+#define POSIX_ULF_WAKE_ALL        0x00000100
+#define POSIX_ULF_NO_ERRNO        0x01000000
+extern int __ulock_wait(uint32_t operation, void *address, uint64_t value, uint32_t timeout);
+extern int __ulock_wake(uint32_t operation, void *address, uint64_t wake_value);
+#else
+#include <linux/futex.h>
+#include <limits.h>
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define POSIX_OPAQUE __attribute__((noipa))
+#else
+#define POSIX_OPAQUE __attribute__((noinline))
+#endif
+
+typedef struct Posix_Thread_Start Posix_Thread_Start;
+struct Posix_Thread_Start {
+    Platform_Thread_Proc *proc;
+    void *data;
+    char *name;
+    Platform_Thread_Event started;
+};
+
+static void *posix_thread_proc(void *param) {
+    Posix_Thread_Start *start = (Posix_Thread_Start *)param;
+    Platform_Thread_Proc *proc = start->proc;
+    void *data = start->data;
+    if (start->name) {
+        // Both limit the name to 15 characters plus the terminator.
+        char name[16];
+        snprintf(name, sizeof(name), "%s", start->name);
+#if defined(__APPLE__)
+        pthread_setname_np(name);
+#else
+        pthread_setname_np(pthread_self(), name);
+#endif
+    }
+    // start lives on the creating thread's stack, it is gone after this.
+    platform_thread_event_set(&start->started);
+    proc(data);
+    return 0;
+}
+
+Platform_Thread platform_thread_create(Platform_Thread_Proc *proc, void *data, char *name) {
+    Platform_Thread result = {0};
+    Posix_Thread_Start start = {0};
+    start.proc = proc;
+    start.data = data;
+    start.name = name;
+
+    pthread_t thread;
+    if (pthread_create(&thread, 0, posix_thread_proc, &start) != 0) {
+        platform_log("Failed to create thread '%s'.\n", name ? name : "");
+        return result;
+    }
+    platform_thread_event_wait(&start.started);
+    result.handle = (u64)thread;
+    return result;
+}
+
+void platform_thread_join(Platform_Thread thread) {
+    if (thread.handle) pthread_join((pthread_t)thread.handle, 0);
+}
+
+void platform_thread_set_affinity(Platform_Thread thread, u32 core) {
+#if defined(__APPLE__)
+    // macOS only takes affinity tags as a hint, threads with the same tag
+    // are kept on a shared L2. Apple silicon ignores them.
+    thread_affinity_policy_data_t policy = { (integer_t)core + 1 };
+    thread_policy_set(pthread_mach_thread_np((pthread_t)thread.handle), THREAD_AFFINITY_POLICY,
+                      (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT);
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np((pthread_t)thread.handle, sizeof(set), &set);
+#endif
+}
+
+u32 platform_get_thread_id() {
+#if defined(__APPLE__)
+    u64 id;
+    pthread_threadid_np(0, &id);
+    return (u32)id;
+#else
+    return (u32)syscall(SYS_gettid);
+#endif
+}
+
+u32 platform_get_core_count() {
+#if defined(__linux__)
+    // Respects the affinity mask of the process (taskset, cgroups).
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        return (u32)CPU_COUNT(&set);
+    }
+#endif
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+}
+
+void platform_thread_yield() {
+    sched_yield();
+}
+
+static Platform_Crash_Proc *global_crash_proc;
+static int global_crash_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+
+// SA_RESETHAND puts the default action back, so raising the signal again
+// ends the process the way it would have without us.
+static void posix_crash_signal_handler(int signal_number) {
+    Platform_Crash_Proc *proc = global_crash_proc;
+    global_crash_proc = 0;
+    if (proc) proc();
+    raise(signal_number);
+}
+
+void platform_set_crash_handler(Platform_Crash_Proc *proc) {
+    global_crash_proc = proc;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = proc ? posix_crash_signal_handler : SIG_DFL;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    for (u32 i = 0; i < ArrayCount(global_crash_signals); ++i) {
+        sigaction(global_crash_signals[i], &action, 0);
+    }
+}
+
+// glibc declares syscall() as a leaf function. Seeing through the wait, GCC
+// concludes it cannot change statics that only other threads write and
+// hoists their loads out of wait loops, so it must stay opaque.
+POSIX_OPAQUE void platform_futex_wait(volatile u32 *address, u32 expected) {
+#if defined(__APPLE__)
+    __ulock_wait(POSIX_UL_COMPARE_AND_WAIT | POSIX_ULF_NO_ERRNO, (void *)address, expected, 0);
+#else
+    syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, 0, 0, 0);
+#endif
+}
+
+// Returns 0 on timeout.
+POSIX_OPAQUE b32 platform_futex_wait_timeout(volatile u32 *address, u32 expected, u32 timeout_ms) {
+#if defined(__APPLE__)
+    int result = __ulock_wait(POSIX_UL_COMPARE_AND_WAIT | POSIX_ULF_NO_ERRNO, (void *)address, expected,
+                              timeout_ms * 1000);
+    return result != -ETIMEDOUT;
+#else
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+    long result = syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, &timeout, 0, 0);
+    return result == 0 || errno != ETIMEDOUT;
+#endif
+}
+
+void platform_futex_wake(volatile u32 *address, b32 wake_all) {
+#if defined(__APPLE__)
+    u32 operation = POSIX_UL_COMPARE_AND_WAIT | POSIX_ULF_NO_ERRNO;
+    if (wake_all) operation |= POSIX_ULF_WAKE_ALL;
+    __ulock_wake(operation, (void *)address, 0);
+#else
+    syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, wake_all ? INT_MAX : 1, 0, 0, 0);
+#endif
+}
+
+
+// =========================
+// >> Fibers
+//
+// posix_fiber_switch pushes the callee-saved registers onto the current
+// stack, stores the stack pointer in *from, loads to and pops them again.
+// A new fiber gets a stack that looks as if it had been switched away
+// from right before posix_fiber_start, which calls posix_fiber_main with
+// the fiber in a callee-saved register.
+
+#if defined(__APPLE__)
+#define POSIX_ASM_SYMBOL(name) "_" #name
+#else
+#define POSIX_ASM_SYMBOL(name) #name
+#endif
+
+void posix_fiber_switch(void **from, void *to);
+void posix_fiber_start();
+void posix_fiber_main(Platform_Fiber *fiber);
+
+// Only called from the assembly above, so it has to keep its name.
+__attribute__((used, noinline)) void posix_fiber_main(Platform_Fiber *fiber) {
+    fiber->proc(fiber->data);
+    platform_log("Fiber proc returned, fibers have to switch away instead.\n");
+    abort();
+}
+
+#if defined(__x86_64__)
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    POSIX_ASM_SYMBOL(posix_fiber_switch) ":\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".p2align 4\n"
+    POSIX_ASM_SYMBOL(posix_fiber_start) ":\n"
+    "    movq %rbx, %rdi\n"
+    "    call " POSIX_ASM_SYMBOL(posix_fiber_main) "\n"
+    "    ud2\n"
+);
+
+// mxcsr/fpu control word, r15, r14, r13, r12, rbx, rbp, return address.
+static void *posix_fiber_setup_stack(Platform_Fiber *fiber, u8 *top) {
+    u64 *sp = (u64 *)top - 8;
+    memset(sp, 0, 8 * sizeof(u64));
+    *(u32 *)&sp[0] = 0x1F80;       // Default mxcsr: all exceptions masked.
+    *((u16 *)&sp[0] + 2) = 0x037F; // Default x87 control word.
+    sp[5] = (u64)fiber;            // rbx
+    sp[7] = (u64)posix_fiber_start;
+    return sp;
+}
+#elif defined(__aarch64__)
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    POSIX_ASM_SYMBOL(posix_fiber_switch) ":\n"
+    "    sub sp, sp, #160\n"
+    "    stp x19, x20, [sp, #0]\n"
+    "    stp x21, x22, [sp, #16]\n"
+    "    stp x23, x24, [sp, #32]\n"
+    "    stp x25, x26, [sp, #48]\n"
+    "    stp x27, x28, [sp, #64]\n"
+    "    stp x29, x30, [sp, #80]\n"
+    "    stp d8, d9, [sp, #96]\n"
+    "    stp d10, d11, [sp, #112]\n"
+    "    stp d12, d13, [sp, #128]\n"
+    "    stp d14, d15, [sp, #144]\n"
+    "    mov x2, sp\n"
+    "    str x2, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldp x19, x20, [sp, #0]\n"
+    "    ldp x21, x22, [sp, #16]\n"
+    "    ldp x23, x24, [sp, #32]\n"
+    "    ldp x25, x26, [sp, #48]\n"
+    "    ldp x27, x28, [sp, #64]\n"
+    "    ldp x29, x30, [sp, #80]\n"
+    "    ldp d8, d9, [sp, #96]\n"
+    "    ldp d10, d11, [sp, #112]\n"
+    "    ldp d12, d13, [sp, #128]\n"
+    "    ldp d14, d15, [sp, #144]\n"
+    "    add sp, sp, #160\n"
+    "    ret\n"
+    ".p2align 4\n"
+    POSIX_ASM_SYMBOL(posix_fiber_start) ":\n"
+    "    mov x0, x19\n"
+    "    bl " POSIX_ASM_SYMBOL(posix_fiber_main) "\n"
+    "    brk #0\n"
+);
+
+// x19-x28, x29, x30 (return address), d8-d15.
+static void *posix_fiber_setup_stack(Platform_Fiber *fiber, u8 *top) {
+    u64 *sp = (u64 *)top - 20;
+    memset(sp, 0, 20 * sizeof(u64));
+    sp[0] = (u64)fiber;             // x19
+    sp[11] = (u64)posix_fiber_start; // x30
+    return sp;
+}
+#else
+#error "Fibers are not implemented for this architecture."
+#endif
+
+// The stack is reserved with an inaccessible guard page at its low end.
+// Committing only changes the protection, the OS backs the pages when
+// they are first touched.
+b32 platform_fiber_init(Platform_Fiber *fiber, Platform_Fiber_Proc *proc, void *data, u64 stack_size) {
+    u64 page_size = (u64)sysconf(_SC_PAGESIZE);
+    stack_size = (stack_size + page_size - 1) & ~(page_size - 1);
+
+    memset(fiber, 0, sizeof(*fiber));
+    fiber->stack_size = stack_size + page_size;
+    fiber->stack = platform_reserve_memory(fiber->stack_size);
+    if (fiber->stack == MAP_FAILED || !fiber->stack) {
+        fiber->stack = 0;
+        return 0;
+    }
+    platform_commit_memory((u8 *)fiber->stack + page_size, stack_size);
+
+    fiber->proc = proc;
+    fiber->data = data;
+    fiber->context = posix_fiber_setup_stack(fiber, (u8 *)fiber->stack + fiber->stack_size);
+    return 1;
+}
+
+void platform_fiber_init_from_thread(Platform_Fiber *fiber) {
+    memset(fiber, 0, sizeof(*fiber));
+    fiber->is_thread = 1;
+}
+
+void platform_fiber_release(Platform_Fiber *fiber) {
+    if (fiber->stack) platform_release_memory(fiber->stack, fiber->stack_size);
+    memset(fiber, 0, sizeof(*fiber));
+}
+
+void platform_fiber_switch(Platform_Fiber *from, Platform_Fiber *to) {
+    posix_fiber_switch(&from->context, to->context);
+}
+
+
+// =========================
+// >> Time
+
+#include <time.h>
+
+u64 platform_get_time_ns() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (u64)time.tv_sec * 1000000000ull + (u64)time.tv_nsec;
+}
+
+void platform_sleep_ns(u64 duration) {
+    struct timespec time;
+    time.tv_sec  = (time_t)(duration / 1000000000ull);
+    time.tv_nsec = (long)(duration % 1000000000ull);
+    while (nanosleep(&time, &time) == -1 && errno == EINTR);
+}
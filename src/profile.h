@@ -0,0 +1,443 @@
+/* profile.h - v0.1 - Sven A. Schreiber
+ *
+ * profile.h is a single header file library for timing zones of code
+ * while the app runs. It is part of and depends on my C base-layer.
+ *
+ * A zone is opened with ProfileBegin and closed with ProfileEnd, or
+ * wraps a block with ProfileScope. Zones nest. Opening one stores the
+ * name, the depth and a cpu_cycle_counter timestamp in a ring owned by
+ * the calling thread, so no thread ever waits on another one. Names
+ * must stay valid for as long as the profiler runs, which string
+ * literals always do. Leaving a ProfileScope block with break, return
+ * or goto skips the end of the zone, use ProfileBegin and ProfileEnd
+ * around such code instead.
+ *
+ * profile_frame_end collects the zones that were closed since the last
+ * call on all threads and sums them up by name: number of calls, total,
+ * self (without nested zones) and longest time. The result stays
+ * available through profile_get_frame until the next frame ends. Call
+ * it outside of any zone of the same thread, a zone that is still open
+ * holds back the ones after it until it is closed.
+ *
+ * profile_write_trace writes the zones that are still in the rings, the
+ * last PROFILE_THREAD_ZONES of each thread, as a Chrome trace, which
+ * chrome://tracing and ui.perfetto.dev both open.
+ *
+ * Everything is compiled out unless PROFILE_ENABLED is defined to 1 in
+ * the build file, the macros expand to nothing and the implementation
+ * is left out, so zones can stay in the code for good.
+ *
+ * To use this file simply define PROFILE_IMPL once at the start of
+ * your project before including it. After that you can include it
+ * without defining PROFILE_IMPL as per usual.
+ *
+ * Example:
+ * ...
+ * #define PROFILE_IMPL
+ * #include "profile.h"
+ * ...
+ * ProfileScope("update") {
+ *     ...
+ * }
+ * ProfileFrameEnd();
+ * ...
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// +============+
+// | DEFINTIONS |
+// +============+
+
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 0
+#endif
+
+#define PROFILE_MAX_THREADS    64
+#define PROFILE_THREAD_ZONES   (1 << 16) // Power of two.
+#define PROFILE_MAX_DEPTH      64
+#define PROFILE_MAX_FRAME_ZONES 256      // Distinct names per frame.
+
+typedef struct Profile_Zone Profile_Zone;
+struct Profile_Zone {
+    char *name;
+    u64 start;
+    u64 end; // 0 while the zone is open.
+    u32 depth;
+    u32 pad;
+};
+
+typedef struct Profile_Thread Profile_Thread;
+struct Profile_Thread {
+    Profile_Zone *zones;
+    u64 count;              // Zones ever opened, written by the owner only.
+    u64 cursor;             // First zone profile_frame_end has not summed up.
+    u64 lost;               // Zones overwritten before they were summed up.
+    u32 depth;
+    u32 thread_id;
+    char *name;
+    u64 open[PROFILE_MAX_DEPTH];
+};
+
+typedef struct Profile_Stat Profile_Stat;
+struct Profile_Stat {
+    char *name;
+    u32 calls;
+    u32 depth; // Smallest depth the zone was seen at.
+    u64 total_cycles;
+    s64 self_cycles;
+    u64 max_cycles;
+    f64 total_ms;
+    f64 self_ms;
+    f64 max_ms;
+};
+
+typedef struct Profile_Frame Profile_Frame;
+struct Profile_Frame {
+    u64 index;
+    u64 start_cycles;
+    u64 end_cycles;
+    f64 ms;
+    u64 lost;
+    u32 stat_count;
+    Profile_Stat stats[PROFILE_MAX_FRAME_ZONES];
+};
+
+typedef struct Profiler Profiler;
+struct Profiler {
+    b32 initialized;
+    u64 start_cycles;
+    f64 cycles_per_ns;
+    Platform_Mutex register_mutex;
+    Profile_Thread *threads[PROFILE_MAX_THREADS];
+    u32 thread_count;
+    Profile_Frame frames[2];
+    Profile_Frame *last_frame;
+    u64 frame_count;
+    u64 frame_start_cycles;
+};
+
+
+// +===========+
+// | INTERFACE |
+// +===========+
+
+void profile_init();
+void profile_begin(char *name);
+void profile_end();
+void profile_set_thread_name(char *name);
+void profile_frame_end();
+Profile_Frame *profile_get_frame();
+f64 profile_cycles_to_ms(u64 cycles);
+b32 profile_write_trace(Mem_Arena *arena, char *file_name);
+
+
+// +===============+
+// | HELPER MACROS |
+// +===============+
+
+#if PROFILE_ENABLED
+#define ProfileInit()                profile_init()
+#define ProfileBegin(name)           profile_begin(name)
+#define ProfileEnd()                 profile_end()
+#define ProfileScope(name)           for (int profile_scope__ = (profile_begin(name), 0); !profile_scope__; profile_scope__ = (profile_end(), 1))
+#define ProfileThreadName(name)      profile_set_thread_name(name)
+#define ProfileFrameEnd()            profile_frame_end()
+#else
+#define ProfileInit()
+#define ProfileBegin(name)
+#define ProfileEnd()
+#define ProfileScope(name)
+#define ProfileThreadName(name)
+#define ProfileFrameEnd()
+#endif
+
+
+// +================+
+// | IMPLEMENTATION |
+// +================+
+
+#if defined(PROFILE_IMPL) && PROFILE_ENABLED
+
+static Profiler profiler;
+static ThreadLocal Profile_Thread *profile_thread;
+
+// =========================
+// >> Setup
+
+void profile_init() {
+    if (profiler.initialized) return;
+    profiler.cycles_per_ns      = platform_get_cycles_per_ns();
+    profiler.start_cycles       = cpu_cycle_counter();
+    profiler.frame_start_cycles = profiler.start_cycles;
+    atomic_store_u32(&profiler.initialized, 1);
+}
+
+static void profile_calibrate() {
+    profiler.cycles_per_ns = platform_get_cycles_per_ns();
+}
+
+f64 profile_cycles_to_ms(u64 cycles) {
+    return (f64)cycles / profiler.cycles_per_ns / 1000000.0;
+}
+
+// Returns 0 before profile_init and once PROFILE_MAX_THREADS threads
+// have zones, such a thread is not profiled.
+static Profile_Thread *profile_get_thread() {
+    Profile_Thread *thread = profile_thread;
+    if (thread || !profiler.initialized) return thread;
+
+    platform_mutex_lock(&profiler.register_mutex);
+    u32 count = profiler.thread_count;
+    if (count < PROFILE_MAX_THREADS) {
+        u64 size = sizeof(Profile_Thread) + PROFILE_THREAD_ZONES * sizeof(Profile_Zone);
+        u8 *memory = (u8 *)platform_reserve_memory(size);
+        if (memory) {
+            platform_commit_memory(memory, size);
+            thread = (Profile_Thread *)memory;
+            memset(thread, 0, sizeof(*thread));
+            thread->zones     = (Profile_Zone *)(memory + sizeof(Profile_Thread));
+            thread->thread_id = platform_get_thread_id();
+            profiler.threads[count] = thread;
+            atomic_store_u32(&profiler.thread_count, count + 1);
+        }
+    }
+    platform_mutex_unlock(&profiler.register_mutex);
+
+    profile_thread = thread;
+    return thread;
+}
+
+// Shows up as the thread's name in the trace.
+void profile_set_thread_name(char *name) {
+    Profile_Thread *thread = profile_get_thread();
+    if (thread) thread->name = name;
+}
+
+
+// =========================
+// >> Zones
+
+// The zone is published through count before its timestamp is taken,
+// profile_frame_end only reads a zone once end is set, which happens
+// after all of its other fields are written.
+void profile_begin(char *name) {
+    Profile_Thread *thread = profile_get_thread();
+    if (!thread) return;
+
+    u32 depth = thread->depth++;
+    if (depth >= PROFILE_MAX_DEPTH) return;
+
+    u64 index = thread->count;
+    Profile_Zone *zone = &thread->zones[index & (PROFILE_THREAD_ZONES - 1)];
+    zone->end   = 0;
+    zone->name  = name;
+    zone->depth = depth;
+    thread->open[depth] = index;
+    atomic_store_u64(&thread->count, index + 1);
+    zone->start = cpu_cycle_counter();
+}
+
+void profile_end() {
+    u64 cycles = cpu_cycle_counter();
+    Profile_Thread *thread = profile_thread;
+    if (!thread || !thread->depth) return;
+
+    u32 depth = --thread->depth;
+    if (depth >= PROFILE_MAX_DEPTH) return;
+
+    u64 index = thread->open[depth];
+    if (thread->count - index > PROFILE_THREAD_ZONES) return;
+    atomic_store_u64(&thread->zones[index & (PROFILE_THREAD_ZONES - 1)].end, cycles);
+}
+
+
+// =========================
+// >> Frames
+
+static u64 profile_hash_name(char *name) {
+    u64 hash = 14695981039346656037ull;
+    for (char *at = name; *at; ++at) {
+        hash = (hash ^ (u8)*at) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Names are compared by text, the same literal in two places does not
+// have to share its address.
+static Profile_Stat *profile_frame_get_stat(Profile_Frame *frame, u16 *slots, char *name, u32 depth) {
+    u32 mask = PROFILE_MAX_FRAME_ZONES * 2 - 1;
+    for (u32 slot = (u32)profile_hash_name(name) & mask;; slot = (slot + 1) & mask) {
+        u16 index = slots[slot];
+        if (!index) {
+            if (frame->stat_count == PROFILE_MAX_FRAME_ZONES) return 0;
+            Profile_Stat *stat = &frame->stats[frame->stat_count++];
+            memset(stat, 0, sizeof(*stat));
+            stat->name  = name;
+            stat->depth = depth;
+            slots[slot] = (u16)frame->stat_count;
+            return stat;
+        }
+        Profile_Stat *stat = &frame->stats[index - 1];
+        if (stat->name == name || strcmp(stat->name, name) == 0) {
+            stat->depth = Min(stat->depth, depth);
+            return stat;
+        }
+    }
+}
+
+// Zones of a thread are stored in the order they were opened, so the
+// parent of a zone is the last one before it that is one level up.
+static void profile_frame_collect(Profile_Frame *frame, u16 *slots, Profile_Thread *thread) {
+    Profile_Stat *parents[PROFILE_MAX_DEPTH] = {0};
+
+    u64 count = atomic_load_u64(&thread->count);
+    if (count - thread->cursor > PROFILE_THREAD_ZONES) {
+        thread->lost  += count - PROFILE_THREAD_ZONES - thread->cursor;
+        thread->cursor = count - PROFILE_THREAD_ZONES;
+    }
+
+    while (thread->cursor < count) {
+        Profile_Zone *zone = &thread->zones[thread->cursor & (PROFILE_THREAD_ZONES - 1)];
+        u64 end = atomic_load_u64(&zone->end);
+        if (!end) break;
+        char *name = zone->name;
+        u64 start = zone->start;
+        u32 depth = zone->depth;
+        // The owner may have wrapped around onto this zone meanwhile.
+        if (atomic_load_u64(&thread->count) - thread->cursor > PROFILE_THREAD_ZONES) break;
+        thread->cursor += 1;
+
+        u64 cycles = end > start ? end - start : 0;
+        Profile_Stat *stat = profile_frame_get_stat(frame, slots, name, depth);
+        if (stat) {
+            stat->calls        += 1;
+            stat->total_cycles += cycles;
+            stat->self_cycles  += cycles;
+            stat->max_cycles    = Max(stat->max_cycles, cycles);
+        }
+        if (depth > 0 && parents[depth - 1]) {
+            parents[depth - 1]->self_cycles -= cycles;
+        }
+        parents[depth] = stat;
+        for (u32 i = depth + 1; i < PROFILE_MAX_DEPTH && parents[i]; ++i) {
+            parents[i] = 0;
+        }
+    }
+}
+
+// Sums up the zones closed since the previous call, call it once per
+// frame on the main thread.
+void profile_frame_end() {
+    if (!profiler.initialized) return;
+    profile_calibrate();
+
+    Profile_Frame *frame = &profiler.frames[profiler.frame_count & 1];
+    frame->index        = profiler.frame_count;
+    frame->start_cycles = profiler.frame_start_cycles;
+    frame->end_cycles   = cpu_cycle_counter();
+    frame->ms           = profile_cycles_to_ms(frame->end_cycles - frame->start_cycles);
+    frame->stat_count   = 0;
+
+    u16 slots[PROFILE_MAX_FRAME_ZONES * 2] = {0};
+    u64 lost = 0;
+    u32 thread_count = atomic_load_u32(&profiler.thread_count);
+    for (u32 i = 0; i < thread_count; ++i) {
+        Profile_Thread *thread = profiler.threads[i];
+        profile_frame_collect(frame, slots, thread);
+        lost += thread->lost;
+    }
+    frame->lost = lost;
+
+    for (u32 i = 0; i < frame->stat_count; ++i) {
+        Profile_Stat *stat = &frame->stats[i];
+        stat->total_ms = profile_cycles_to_ms(stat->total_cycles);
+        stat->self_ms  = profile_cycles_to_ms(stat->self_cycles > 0 ? (u64)stat->self_cycles : 0);
+        stat->max_ms   = profile_cycles_to_ms(stat->max_cycles);
+    }
+
+    profiler.last_frame = frame;
+    profiler.frame_count += 1;
+    profiler.frame_start_cycles = frame->end_cycles;
+}
+
+// The summary of the last finished frame, 0 before the first one.
+Profile_Frame *profile_get_frame() {
+    return profiler.last_frame;
+}
+
+
+// =========================
+// >> Chrome trace
+
+static void profile_trace_write(File_Writer *writer, char *text, int size) {
+    String string = {0};
+    string.str = (u8 *)text;
+    string.size = size > 0 ? (u64)size : 0;
+    file_writer_write(writer, string);
+}
+
+// Zone names are written as they are apart from quotes, backslashes and
+// control characters.
+static void profile_trace_escape(char *dest, u32 dest_size, char *name) {
+    u32 size = 0;
+    for (char *at = name; *at && size + 2 < dest_size; ++at) {
+        char c = *at;
+        if (c == '"' || c == '\\') dest[size++] = '\\';
+        dest[size++] = (u8)c < 0x20 ? ' ' : c;
+    }
+    dest[size] = 0;
+}
+
+// Writes the zones of all threads that are still in their rings and have
+// been closed. Timestamps are in microseconds since profile_init.
+b32 profile_write_trace(Mem_Arena *arena, char *file_name) {
+    if (!profiler.initialized) return 0;
+    profile_calibrate();
+
+    File_Writer writer;
+    if (!file_writer_open(arena, file_name, 0, &writer)) return 0;
+
+    char text[512];
+    char name[256];
+    b32 first = 1;
+    static char header[] = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    profile_trace_write(&writer, header, sizeof(header) - 1);
+
+    u32 thread_count = atomic_load_u32(&profiler.thread_count);
+    for (u32 i = 0; i < thread_count; ++i) {
+        Profile_Thread *thread = profiler.threads[i];
+        if (thread->name) {
+            profile_trace_escape(name, sizeof(name), thread->name);
+            int size = snprintf(text, sizeof(text), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                                first ? "" : ",\n", thread->thread_id, name);
+            profile_trace_write(&writer, text, size);
+            first = 0;
+        }
+
+        u64 count = atomic_load_u64(&thread->count);
+        u64 begin = count > PROFILE_THREAD_ZONES ? count - PROFILE_THREAD_ZONES : 0;
+        for (u64 index = begin; index < count; ++index) {
+            Profile_Zone *zone = &thread->zones[index & (PROFILE_THREAD_ZONES - 1)];
+            u64 end = atomic_load_u64(&zone->end);
+            if (!end || end < zone->start) continue;
+
+            f64 ts = (f64)(s64)(zone->start - profiler.start_cycles) / profiler.cycles_per_ns / 1000.0;
+            f64 dur = (f64)(end - zone->start) / profiler.cycles_per_ns / 1000.0;
+            profile_trace_escape(name, sizeof(name), zone->name);
+            int size = snprintf(text, sizeof(text), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                                first ? "" : ",\n", name, thread->thread_id, ts, dur);
+            profile_trace_write(&writer, text, size);
+            first = 0;
+        }
+    }
+
+    static char footer[] = "\n]}\n";
+    profile_trace_write(&writer, footer, sizeof(footer) - 1);
+    return file_writer_close(&writer);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,343 @@
+/* record.h - v0.1 - Sven A. Schreiber
+ *
+ * record.h is a single header file library for recording the input of
+ * a session and replaying it later. It is part of and depends on my C
+ * base-layer.
+ *
+ * A recording stores, for every frame, the delta time, the window size
+ * and the events the app consumed. Replaying pushes the events of one
+ * frame at a time back through platform_push_replayed_event and sets
+ * the delta and window size, so app_update runs exactly the same frames
+ * with the same timing, as fast as the machine allows. Live input has
+ * to be turned off with platform_set_live_events meanwhile.
+ *
+ * File format (little endian):
+ *   u32 magic, u32 version
+ *   per frame:
+ *     u8 flags (bit 0: the window size changed)
+ *     varint delta in ns
+ *     [zigzag varint width, zigzag varint height]
+ *     events, each an u8 type followed by its fields, and a 0 byte
+ *
+ * Keys and characters are varints, mouse positions are stored as the
+ * difference to the previous one, so a frame with a few mouse moves
+ * takes a handful of bytes.
+ *
+ * To use this file simply define RECORD_IMPL once at the start of
+ * your project before including it. After that you can include it
+ * without defining RECORD_IMPL as per usual.
+ *
+ * Example:
+ * ...
+ * #define RECORD_IMPL
+ * #include "record.h"
+ * ...
+ */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+// +============+
+// | DEFINTIONS |
+// +============+
+
+#define INPUT_RECORD_MAGIC   0x43455249 // "IREC"
+#define INPUT_RECORD_VERSION 1
+
+#define INPUT_RECORD_FLAG_WINDOW_SIZE (1 << 0)
+
+typedef struct Input_Recorder Input_Recorder;
+struct Input_Recorder {
+    File_Writer writer;
+    b32 in_frame;
+    s32 window_width;
+    s32 window_height;
+    ivec2 mouse_pos;
+    u64 frames;
+    u64 events;
+};
+
+typedef struct Input_Replay Input_Replay;
+struct Input_Replay {
+    String data;
+    u64 pos;
+    s32 window_width;
+    s32 window_height;
+    ivec2 mouse_pos;
+    u64 frames;
+    b32 failed;
+};
+
+
+// +===========+
+// | INTERFACE |
+// +===========+
+
+b32 input_recorder_open(Mem_Arena *arena, char *file_name, Input_Recorder *recorder);
+void input_recorder_begin_frame(Input_Recorder *recorder);
+void input_recorder_event(Input_Recorder *recorder, Platform_Event *event);
+b32 input_recorder_close(Input_Recorder *recorder);
+
+b32 input_replay_open(char *file_name, Input_Replay *replay);
+b32 input_replay_next_frame(Input_Replay *replay);
+void input_replay_close(Input_Replay *replay);
+
+
+// +================+
+// | IMPLEMENTATION |
+// +================+
+
+#ifdef RECORD_IMPL
+
+// =========================
+// >> Encoding
+
+static u32 input_record_put_varint(u8 *dest, u64 value) {
+    u32 size = 0;
+    while (value >= 0x80) {
+        dest[size++] = (u8)(value | 0x80);
+        value >>= 7;
+    }
+    dest[size++] = (u8)value;
+    return size;
+}
+
+static u32 input_record_put_svarint(u8 *dest, s64 value) {
+    return input_record_put_varint(dest, ((u64)value << 1) ^ (u64)(value >> 63));
+}
+
+static u32 input_record_put_u32(u8 *dest, u32 value) {
+    dest[0] = (u8)value;
+    dest[1] = (u8)(value >> 8);
+    dest[2] = (u8)(value >> 16);
+    dest[3] = (u8)(value >> 24);
+    return 4;
+}
+
+static void input_recorder_write(Input_Recorder *recorder, u8 *data, u64 size) {
+    String string = {0};
+    string.str = data;
+    string.size = size;
+    file_writer_write(&recorder->writer, string);
+}
+
+static b32 input_replay_get_varint(Input_Replay *replay, u64 *value) {
+    u64 result = 0;
+    for (u32 shift = 0; shift < 64; shift += 7) {
+        if (replay->pos >= replay->data.size) break;
+        u8 byte = replay->data.str[replay->pos++];
+        result |= (u64)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 1;
+        }
+    }
+    replay->failed = 1;
+    return 0;
+}
+
+static s64 input_replay_get_svarint(Input_Replay *replay) {
+    u64 value = 0;
+    input_replay_get_varint(replay, &value);
+    return (s64)(value >> 1) ^ -(s64)(value & 1);
+}
+
+static u8 input_replay_get_u8(Input_Replay *replay) {
+    if (replay->pos >= replay->data.size) {
+        replay->failed = 1;
+        return 0;
+    }
+    return replay->data.str[replay->pos++];
+}
+
+static u32 input_replay_get_u32(Input_Replay *replay) {
+    if (replay->pos + 4 > replay->data.size) {
+        replay->failed = 1;
+        replay->pos = replay->data.size;
+        return 0;
+    }
+    u8 *p = replay->data.str + replay->pos;
+    replay->pos += 4;
+    return (u32)p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16) | ((u32)p[3] << 24);
+}
+
+
+// =========================
+// >> Recorder
+
+b32 input_recorder_open(Mem_Arena *arena, char *file_name, Input_Recorder *recorder) {
+    memset(recorder, 0, sizeof(*recorder));
+    if (!file_writer_open(arena, file_name, KB(64), &recorder->writer)) return 0;
+
+    u8 header[8];
+    input_record_put_u32(header, INPUT_RECORD_MAGIC);
+    input_record_put_u32(header + 4, INPUT_RECORD_VERSION);
+    input_recorder_write(recorder, header, sizeof(header));
+    return 1;
+}
+
+static void input_recorder_end_frame(Input_Recorder *recorder) {
+    if (recorder->in_frame) {
+        u8 end = Platform_Event_Type_None;
+        input_recorder_write(recorder, &end, 1);
+        recorder->in_frame = 0;
+    }
+}
+
+// Call once per frame before any event of the frame is recorded, it
+// takes the delta and window size from platform_state.
+void input_recorder_begin_frame(Input_Recorder *recorder) {
+    input_recorder_end_frame(recorder);
+
+    u8 buffer[32];
+    u32 size = 0;
+    s32 width = platform_state->window_width;
+    s32 height = platform_state->window_height;
+    b32 size_changed = recorder->frames == 0 || width != recorder->window_width || height != recorder->window_height;
+
+    buffer[size++] = size_changed ? INPUT_RECORD_FLAG_WINDOW_SIZE : 0;
+    size += input_record_put_varint(buffer + size, platform_state->delta_ns);
+    if (size_changed) {
+        size += input_record_put_svarint(buffer + size, width);
+        size += input_record_put_svarint(buffer + size, height);
+        recorder->window_width = width;
+        recorder->window_height = height;
+    }
+    input_recorder_write(recorder, buffer, size);
+    recorder->in_frame = 1;
+    recorder->frames += 1;
+}
+
+void input_recorder_event(Input_Recorder *recorder, Platform_Event *event) {
+    if (!recorder->in_frame || event->type == Platform_Event_Type_None) return;
+
+    u8 buffer[32];
+    u32 size = 0;
+    buffer[size++] = (u8)event->type;
+    switch (event->type) {
+        case Platform_Event_Type_Key_Press:
+        case Platform_Event_Type_Key_Release:
+        case Platform_Event_Type_Mouse_Press:
+        case Platform_Event_Type_Mouse_Release: {
+            size += input_record_put_varint(buffer + size, (u32)event->key);
+            buffer[size++] = (u8)event->key_modifiers;
+        } break;
+
+        case Platform_Event_Type_Character_Input: {
+            size += input_record_put_varint(buffer + size, event->character);
+            buffer[size++] = (u8)event->key_modifiers;
+        } break;
+
+        case Platform_Event_Type_Mouse_Move: {
+            size += input_record_put_svarint(buffer + size, (s64)event->mouse_pos.x - recorder->mouse_pos.x);
+            size += input_record_put_svarint(buffer + size, (s64)event->mouse_pos.y - recorder->mouse_pos.y);
+            recorder->mouse_pos = event->mouse_pos;
+        } break;
+
+        case Platform_Event_Type_Mouse_Scroll: {
+            size += input_record_put_svarint(buffer + size, event->scroll_delta);
+        } break;
+    }
+    input_recorder_write(recorder, buffer, size);
+    recorder->events += 1;
+}
+
+b32 input_recorder_close(Input_Recorder *recorder) {
+    input_recorder_end_frame(recorder);
+    return file_writer_close(&recorder->writer);
+}
+
+
+// =========================
+// >> Replay
+
+b32 input_replay_open(char *file_name, Input_Replay *replay) {
+    memset(replay, 0, sizeof(*replay));
+    if (!platform_map_file(file_name, Platform_Map_Flag_Sequential, &replay->data)) return 0;
+
+    if (input_replay_get_u32(replay) != INPUT_RECORD_MAGIC ||
+        input_replay_get_u32(replay) != INPUT_RECORD_VERSION) {
+        platform_log("'%s' is not an input recording.\n", file_name);
+        input_replay_close(replay);
+        return 0;
+    }
+    return 1;
+}
+
+// Pushes the events of the next frame and sets delta and window size in
+// platform_state. Returns 0 once the recording is over or broken.
+b32 input_replay_next_frame(Input_Replay *replay) {
+    if (replay->failed || replay->pos >= replay->data.size) return 0;
+
+    u8 flags = input_replay_get_u8(replay);
+    u64 delta_ns = 0;
+    input_replay_get_varint(replay, &delta_ns);
+    if (flags & INPUT_RECORD_FLAG_WINDOW_SIZE) {
+        replay->window_width = (s32)input_replay_get_svarint(replay);
+        replay->window_height = (s32)input_replay_get_svarint(replay);
+    }
+
+    for (;;) {
+        Platform_Event event = {0};
+        event.type = (Platform_Event_Type)input_replay_get_u8(replay);
+        if (event.type == Platform_Event_Type_None || replay->failed) break;
+
+        u64 value = 0;
+        switch (event.type) {
+            case Platform_Event_Type_Key_Press:
+            case Platform_Event_Type_Key_Release:
+            case Platform_Event_Type_Mouse_Press:
+            case Platform_Event_Type_Mouse_Release: {
+                input_replay_get_varint(replay, &value);
+                event.key = (Key)value;
+                event.key_modifiers = input_replay_get_u8(replay);
+            } break;
+
+            case Platform_Event_Type_Character_Input: {
+                input_replay_get_varint(replay, &value);
+                event.character = (u32)value;
+                event.key_modifiers = input_replay_get_u8(replay);
+            } break;
+
+            case Platform_Event_Type_Mouse_Move: {
+                replay->mouse_pos.x += (s32)input_replay_get_svarint(replay);
+                replay->mouse_pos.y += (s32)input_replay_get_svarint(replay);
+                event.mouse_pos = replay->mouse_pos;
+            } break;
+
+            case Platform_Event_Type_Mouse_Scroll: {
+                event.scroll_delta = (s32)input_replay_get_svarint(replay);
+            } break;
+
+            case Platform_Event_Type_Cursor_Enter:
+            case Platform_Event_Type_Cursor_Leave: {
+            } break;
+
+            default: {
+                replay->failed = 1;
+            } break;
+        }
+        if (replay->failed) break;
+        platform_push_replayed_event(event);
+    }
+
+    if (replay->failed) {
+        platform_log("Input recording is broken after %llu frames.\n", replay->frames);
+        return 0;
+    }
+    platform_state->delta_ns = delta_ns;
+    platform_state->delta    = (f32)((f64)delta_ns / 1000000000.0);
+    platform_state->window_width = replay->window_width;
+    platform_state->window_height = replay->window_height;
+    replay->frames += 1;
+    return 1;
+}
+
+void input_replay_close(Input_Replay *replay) {
+    if (replay->data.str) platform_unmap_file(replay->data);
+    memset(replay, 0, sizeof(*replay));
+}
+
+#endif
+
+#endif
@@ -0,0 +1,196 @@
+/* telemetry.h - v0.1 - Sven A. Schreiber
+ *
+ * telemetry.h is a single header file library for watching a running
+ * process from the outside. It is part of and depends on my C
+ * base-layer.
+ *
+ * The process fills a Telemetry_Frame once per frame and
+ * telemetry_publish copies it into a Telemetry_Block in named shared
+ * memory, where any other process can map it. The block is guarded by
+ * a seqlock: the sequence is odd while a copy is in progress and grows
+ * by two with every publish. telemetry_read keeps a copy of the block
+ * only if the sequence was even before and unchanged after. The writer
+ * never waits for anyone and readers map the block read-only, so a
+ * monitor cannot stall the process. A reader that keeps running into
+ * the writer gives up after TELEMETRY_READ_ATTEMPTS and tries later.
+ *
+ * The frame times of the last TELEMETRY_HISTORY frames are kept in a
+ * ring as well, so graphs do not miss the frames between two reads.
+ * See tools/telemetry_view.c for a reader.
+ *
+ * To use this file simply define TELEMETRY_IMPL once at the start of
+ * your project before including it. After that you can include it
+ * without defining TELEMETRY_IMPL as per usual.
+ *
+ * Example:
+ * ...
+ * #define TELEMETRY_IMPL
+ * #include "telemetry.h"
+ * ...
+ * Telemetry telemetry;
+ * if (telemetry_create(&telemetry, "app")) {
+ *     ...
+ *     telemetry_publish(&telemetry, &frame);
+ *     ...
+ *     telemetry_close(&telemetry);
+ * }
+ * ...
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+// +============+
+// | DEFINTIONS |
+// +============+
+
+#define TELEMETRY_MAGIC          0x4D4C4554 // "TELM"
+#define TELEMETRY_VERSION        1
+#define TELEMETRY_HISTORY        256 // Must be a power of two.
+#define TELEMETRY_READ_ATTEMPTS  64
+
+// Everything the process reports per frame. The counters only ever
+// grow, the rest describes the frame that was just published.
+typedef struct Telemetry_Frame Telemetry_Frame;
+struct Telemetry_Frame {
+    u64 time_ns; // platform_get_time_ns, comparable across processes.
+
+    // In microseconds. frame_us is the time since the previous frame
+    // started, 0 after the platform layer waited for input.
+    u32 frame_us;
+    u32 update_us;
+    u32 render_us;
+    u32 budget_us;
+    u64 hitches;
+    u64 missed_frames;
+
+    // In bytes, the frame arena at the end of the frame.
+    u64 arena_used;
+    u64 arena_committed;
+    u64 frame_arena_used;
+    u64 frame_arena_committed;
+
+    u64 events_depth;
+    u64 events_max_depth;
+    u64 events_pushed;
+    u64 events_coalesced;
+    u64 events_dropped;
+
+    u32 job_workers;
+    u32 job_sleeping;
+    u64 jobs_queued;
+    u64 jobs_executed;
+};
+
+// The layout other processes see. magic is written last when the block
+// is created, readers check it together with version and size.
+typedef struct Telemetry_Block Telemetry_Block;
+struct Telemetry_Block {
+    u32 magic;
+    u32 version;
+    u32 size;
+    u32 history_next;
+    volatile u64 sequence; // Odd while the writer is copying, twice the frames published.
+    Telemetry_Frame frame;
+    u32 history_frame_us[TELEMETRY_HISTORY];
+};
+
+typedef struct Telemetry Telemetry;
+struct Telemetry {
+    Platform_Shared_Memory memory;
+    Telemetry_Block *block;
+};
+
+
+// +===========+
+// | INTERFACE |
+// +===========+
+
+b32 telemetry_create(Telemetry *telemetry, char *name);
+b32 telemetry_connect(Telemetry *telemetry, char *name);
+void telemetry_close(Telemetry *telemetry);
+void telemetry_publish(Telemetry *telemetry, Telemetry_Frame *frame);
+b32 telemetry_read(Telemetry *telemetry, Telemetry_Block *copy);
+
+
+// +================+
+// | IMPLEMENTATION |
+// +================+
+
+#ifdef TELEMETRY_IMPL
+
+// =========================
+// >> Writer
+
+b32 telemetry_create(Telemetry *telemetry, char *name) {
+    memset(telemetry, 0, sizeof(*telemetry));
+    if (!platform_create_shared_memory(name, sizeof(Telemetry_Block), &telemetry->memory)) return 0;
+
+    Telemetry_Block *block = (Telemetry_Block *)telemetry->memory.data;
+    block->version = TELEMETRY_VERSION;
+    block->size    = sizeof(Telemetry_Block);
+    atomic_store_u32(&block->magic, TELEMETRY_MAGIC);
+    telemetry->block = block;
+    return 1;
+}
+
+// Only the process that created the block may publish.
+void telemetry_publish(Telemetry *telemetry, Telemetry_Frame *frame) {
+    Telemetry_Block *block = telemetry->block;
+    u64 sequence = block->sequence;
+    atomic_store_u64(&block->sequence, sequence + 1);
+    atomic_thread_fence();
+
+    block->frame = *frame;
+    block->history_frame_us[block->history_next] = frame->frame_us;
+    block->history_next = (block->history_next + 1) & (TELEMETRY_HISTORY - 1);
+
+    atomic_store_u64(&block->sequence, sequence + 2);
+}
+
+
+// =========================
+// >> Reader
+
+// Fails while no process has created the block under that name or the
+// block was written by a different version.
+b32 telemetry_connect(Telemetry *telemetry, char *name) {
+    memset(telemetry, 0, sizeof(*telemetry));
+    if (!platform_open_shared_memory(name, &telemetry->memory)) return 0;
+
+    Telemetry_Block *block = (Telemetry_Block *)telemetry->memory.data;
+    if (telemetry->memory.size < sizeof(Telemetry_Block) ||
+        atomic_load_u32(&block->magic) != TELEMETRY_MAGIC ||
+        block->version != TELEMETRY_VERSION || block->size != sizeof(Telemetry_Block)) {
+        platform_close_shared_memory(&telemetry->memory);
+        return 0;
+    }
+    telemetry->block = block;
+    return 1;
+}
+
+// Returns 0 if every attempt overlapped with a publish, copy is left in
+// an undefined state then.
+b32 telemetry_read(Telemetry *telemetry, Telemetry_Block *copy) {
+    Telemetry_Block *block = telemetry->block;
+    for (u32 attempt = 0; attempt < TELEMETRY_READ_ATTEMPTS; ++attempt) {
+        u64 sequence = atomic_load_u64(&block->sequence);
+        if (sequence & 1) {
+            cpu_pause();
+            continue;
+        }
+        memcpy(copy, block, sizeof(*copy));
+        atomic_thread_fence();
+        if (atomic_load_u64(&block->sequence) == sequence) return 1;
+    }
+    return 0;
+}
+
+void telemetry_close(Telemetry *telemetry) {
+    platform_close_shared_memory(&telemetry->memory);
+    telemetry->block = 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,259 @@
+/* log_decode.c - v0.1 - Sven A. Schreiber
+ *
+ * Turns a binary log written by log.h (see log_open_binary) back into
+ * the same text the logger writes itself.
+ *
+ * Build:
+ *   cc -O2 -D_GNU_SOURCE -o log_decode src/tools/log_decode.c -lm -lpthread
+ *
+ * Usage:
+ *   log_decode <file>
+ */
+
+#include <stdarg.h>
+#include "../base.h"
+#define MATH_IMPL
+#include "../math.h"
+#define PLATFORM_IMPL
+#include "../platform.h"
+#define MEMORY_IMPL
+#include "../memory.h"
+#define STRING_IMPL
+#include "../string.h"
+#define LOG_IMPL
+#include "../log.h"
+#include "../linux/linux_platform.c"
+
+static void stdout_sink(String text, void *data) {
+    fwrite(text.str, 1, text.size, stdout);
+}
+
+// Returns the number of bytes read, 0 if src ends inside the varint.
+static u32 log_get_varint(u8 *src, u8 *end, u64 *value) {
+    u64 result = 0;
+    for (u32 i = 0; i < 10 && src + i < end; ++i) {
+        result |= (u64)(src[i] & 0x7F) << (7 * i);
+        if (!(src[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+static s64 log_unzigzag(u64 value) {
+    return (s64)(value >> 1) ^ -(s64)(value & 1);
+}
+
+// The reverse of log_pack_args in log.h. Writes the arguments behind
+// record, which needs LOG_MAX_RECORD_SIZE bytes, and sets used. Returns
+// 0 if src is broken.
+static b32 log_unpack_args(Log_Record *record, u8 *src, u8 *src_end) {
+    u8 *args = (u8 *)(record + 1);
+    u8 *args_end = (u8 *)record + LOG_MAX_RECORD_SIZE;
+    u64 value = 0;
+    for (char *at = record->format; *at && src < src_end;) {
+        if (*at != '%') {
+            at++;
+            continue;
+        }
+        Log_Spec spec;
+        at = log_parse_spec(at, &spec);
+        u32 stars = spec.width_star + spec.precision_star;
+        for (u32 i = 0; i < stars; ++i) {
+            u32 read = log_get_varint(src, src_end, &value);
+            if (!read || args + 8 > args_end) return 0;
+            *(s64 *)args = log_unzigzag(value);
+            src += read;
+            args += 8;
+        }
+        switch (spec.kind) {
+            case Log_Arg_Kind_Int:
+            case Log_Arg_Kind_Long:
+            case Log_Arg_Kind_Int64:
+            case Log_Arg_Kind_Pointer: {
+                u32 read = log_get_varint(src, src_end, &value);
+                if (!read || args + 8 > args_end) return 0;
+                *(s64 *)args = log_unzigzag(value);
+                src += read;
+                args += 8;
+            } break;
+            case Log_Arg_Kind_Double: {
+                if (src + 8 > src_end || args + 8 > args_end) return 0;
+                memcpy(args, src, 8);
+                src += 8;
+                args += 8;
+            } break;
+            case Log_Arg_Kind_String: {
+                u32 read = log_get_varint(src, src_end, &value);
+                if (!read || value > (u64)(src_end - src - read)) return 0;
+                if (args + AlignPow2(4 + value + 1, 8) > args_end) return 0;
+                *(u32 *)args = (u32)value;
+                memcpy(args + 4, src + read, value);
+                args[4 + value] = 0;
+                src += read + value;
+                args += AlignPow2(4 + value + 1, 8);
+            } break;
+        }
+    }
+    record->used = (u16)(args - (u8 *)record);
+    return 1;
+}
+
+typedef struct Decoder Decoder;
+struct Decoder {
+    u8 *at;
+    u8 *end;
+    b32 failed;
+};
+
+static u64 decoder_varint(Decoder *decoder) {
+    u64 value = 0;
+    u32 read = log_get_varint(decoder->at, decoder->end, &value);
+    if (!read) decoder->failed = 1;
+    decoder->at += read;
+    return value;
+}
+
+static u64 decoder_u64(Decoder *decoder) {
+    u64 value = 0;
+    if (decoder->at + 8 > decoder->end) {
+        decoder->failed = 1;
+        return 0;
+    }
+    memcpy(&value, decoder->at, 8);
+    decoder->at += 8;
+    return value;
+}
+
+// Walks all entries. The first pass only collects formats and syncs, so
+// the clock rate is known before the second one writes anything.
+static b32 decode(String data, char **formats, Mem_Arena *arena, b32 write_records, u64 *first_sync, u64 *last_sync) {
+    Decoder decoder = {0};
+    decoder.at  = data.str + 8;
+    decoder.end = data.str + data.size;
+    u64 last_cycles = 0;
+    u64 record_buffer[LOG_MAX_RECORD_SIZE / 8];
+    Log_Record *record = (Log_Record *)record_buffer;
+
+    while (decoder.at < decoder.end && !decoder.failed) {
+        u8 tag = *decoder.at++;
+        if (tag == Log_Binary_Tag_End) break;
+
+        switch (tag) {
+            case Log_Binary_Tag_Format: {
+                u64 id = decoder_varint(&decoder);
+                u64 size = decoder_varint(&decoder);
+                if (decoder.failed || id >= LOG_BINARY_MAX_FORMATS || size > (u64)(decoder.end - decoder.at)) {
+                    decoder.failed = 1;
+                    break;
+                }
+                if (!formats[id]) {
+                    formats[id] = PushData(arena, char, size + 1);
+                    memcpy(formats[id], decoder.at, size);
+                    formats[id][size] = 0;
+                }
+                decoder.at += size;
+            } break;
+
+            case Log_Binary_Tag_Sync: {
+                u64 cycles = decoder_u64(&decoder);
+                u64 ns = decoder_u64(&decoder);
+                if (!first_sync[1]) {
+                    first_sync[0] = cycles;
+                    first_sync[1] = ns;
+                }
+                last_sync[0] = cycles;
+                last_sync[1] = ns;
+                last_cycles = cycles;
+            } break;
+
+            case Log_Binary_Tag_Record: {
+                u64 id = decoder_varint(&decoder);
+                u8 level = (decoder.at < decoder.end) ? *decoder.at++ : 0;
+                decoder_varint(&decoder); // Thread id.
+                s64 delta = log_unzigzag(decoder_varint(&decoder));
+                u64 size = decoder_varint(&decoder);
+                if (decoder.failed || id >= LOG_BINARY_MAX_FORMATS || !formats[id] || size > (u64)(decoder.end - decoder.at)) {
+                    decoder.failed = 1;
+                    break;
+                }
+                last_cycles += delta;
+                if (write_records) {
+                    memset(record, 0, sizeof(*record));
+                    record->format = formats[id];
+                    record->level  = level;
+                    record->cycles = last_cycles;
+                    if (!log_unpack_args(record, decoder.at, decoder.at + size)) {
+                        decoder.failed = 1;
+                        break;
+                    }
+                    log_format_record(record);
+                }
+                decoder.at += size;
+            } break;
+
+            case Log_Binary_Tag_Dropped: {
+                u64 thread_id = decoder_varint(&decoder);
+                u64 count = decoder_varint(&decoder);
+                if (write_records && !decoder.failed) {
+                    char text[128];
+                    int size = snprintf(text, sizeof(text), "[log] %llu messages of thread %llu were dropped.\n",
+                                        (unsigned long long)count, (unsigned long long)thread_id);
+                    log_output_append(text, size);
+                }
+            } break;
+
+            default: {
+                decoder.failed = 1;
+            } break;
+        }
+    }
+    if (write_records) log_output_flush();
+    return !decoder.failed;
+}
+
+// Nothing here uses the event queue or the input, but platform.h is
+// built with them and they must not see a null platform_state.
+static Platform_State global_platform_state;
+
+int main(int argc, char **argv) {
+    platform_state = &global_platform_state;
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <file>\n", argv[0]);
+        return 1;
+    }
+
+    String data;
+    if (!platform_map_file(argv[1], Platform_Map_Flag_Sequential, &data)) {
+        fprintf(stderr, "Could not open '%s'.\n", argv[1]);
+        return 1;
+    }
+    u32 header[2] = {0};
+    if (data.size >= 8) memcpy(header, data.str, 8);
+    if (header[0] != LOG_BINARY_MAGIC || header[1] != LOG_BINARY_VERSION) {
+        fprintf(stderr, "'%s' is not a binary log.\n", argv[1]);
+        return 1;
+    }
+
+    Mem_Arena arena = mem_arena_init(GB(1));
+    char **formats = PushDataZero(&arena, char *, LOG_BINARY_MAX_FORMATS);
+    u64 first_sync[2] = {0};
+    u64 last_sync[2] = {0};
+    decode(data, formats, &arena, 0, first_sync, last_sync);
+
+    logger.sink          = stdout_sink;
+    logger.start_cycles  = first_sync[0];
+    logger.start_ns      = first_sync[1];
+    logger.cycles_per_ns = 1.0;
+    if (last_sync[1] > first_sync[1] && last_sync[0] > first_sync[0]) {
+        logger.cycles_per_ns = (f64)(last_sync[0] - first_sync[0]) / (f64)(last_sync[1] - first_sync[1]);
+    }
+
+    if (!decode(data, formats, &arena, 1, first_sync, last_sync)) {
+        fprintf(stderr, "'%s' is broken after this point.\n", argv[1]);
+        return 1;
+    }
+    platform_unmap_file(data);
+    return 0;
+}
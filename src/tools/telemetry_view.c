@@ -0,0 +1,211 @@
+/* telemetry_view.c - v0.1 - Sven A. Schreiber
+ *
+ * Shows the telemetry block of a running app, see telemetry.h. Start
+ * the app with APP_TELEMETRY=<name> and point this at the same name.
+ * It waits for the app to appear and picks it up again after a restart.
+ *
+ * Build:
+ *   cc -O2 -D_GNU_SOURCE -o telemetry_view src/tools/telemetry_view.c -lm -lpthread
+ *
+ * Usage:
+ *   telemetry_view [options] <name>
+ *     --interval MS   time between two reads, default 500
+ *     --graph         draw the frame times of the last frames
+ *     --once          print a single read and exit, 1 if there is none
+ */
+
+#include <stdarg.h>
+#include "../base.h"
+#define MATH_IMPL
+#include "../math.h"
+#define PLATFORM_IMPL
+#include "../platform.h"
+#define MEMORY_IMPL
+#include "../memory.h"
+#define STRING_IMPL
+#include "../string.h"
+#define TELEMETRY_IMPL
+#include "../telemetry.h"
+#include "../linux/linux_platform.c"
+
+#define VIEW_GRAPH_WIDTH     128
+#define VIEW_GRAPH_HEIGHT    16
+#define VIEW_RECONNECT_NS    1000000000ull
+
+typedef struct View View;
+struct View {
+    char *name;
+    Telemetry telemetry;
+    b32 connected;
+    Telemetry_Block block;
+    u64 last_sequence;
+    u64 last_jobs_executed;
+    u64 last_read_ns;
+    u64 last_change_ns;
+};
+
+static f64 view_mb(u64 bytes) {
+    return (f64)bytes / (f64)MB(1);
+}
+
+static f64 view_ms(u32 us) {
+    return (f64)us / 1000.0;
+}
+
+// The frame times published since the previous read, newest last, at
+// most TELEMETRY_HISTORY of them.
+static u32 view_new_frames(View *view) {
+    u64 frames = (view->block.sequence - view->last_sequence) / 2;
+    return (u32)Min(frames, (u64)TELEMETRY_HISTORY);
+}
+
+static u32 view_history(Telemetry_Block *block, u32 back) {
+    return block->history_frame_us[(block->history_next + TELEMETRY_HISTORY - 1 - back) & (TELEMETRY_HISTORY - 1)];
+}
+
+static void view_print(View *view, f64 seconds) {
+    Telemetry_Block *block = &view->block;
+    Telemetry_Frame *frame = &block->frame;
+
+    u32 new_frames = view_new_frames(view);
+    u32 worst = 0;
+    u64 sum = 0;
+    u32 count = 0;
+    for (u32 i = 0; i < new_frames; ++i) {
+        u32 us = view_history(block, i);
+        if (!us) continue;
+        worst = Max(worst, us);
+        sum += us;
+        count += 1;
+    }
+
+    printf("frame %llu: %.2f ms (update %.2f, render %.2f, budget %.2f)\n",
+           block->sequence / 2, view_ms(frame->frame_us), view_ms(frame->update_us),
+           view_ms(frame->render_us), view_ms(frame->budget_us));
+    if (count) {
+        printf("  %u frames since the last read, mean %.2f ms, max %.2f ms\n",
+               new_frames, (f64)sum / (f64)count / 1000.0, view_ms(worst));
+    } else {
+        printf("  %u frames since the last read\n", new_frames);
+    }
+    printf("  hitches %llu, missed frames %llu\n", frame->hitches, frame->missed_frames);
+    printf("  arena %.2f MB used, %.2f MB committed; frame arena %.2f MB used, %.2f MB committed\n",
+           view_mb(frame->arena_used), view_mb(frame->arena_committed),
+           view_mb(frame->frame_arena_used), view_mb(frame->frame_arena_committed));
+    printf("  events %llu queued (max %llu), %llu pushed, %llu coalesced, %llu dropped\n",
+           frame->events_depth, frame->events_max_depth, frame->events_pushed,
+           frame->events_coalesced, frame->events_dropped);
+
+    f64 jobs_per_second = 0.0;
+    if (seconds > 0.0 && view->last_jobs_executed <= frame->jobs_executed) {
+        jobs_per_second = (f64)(frame->jobs_executed - view->last_jobs_executed) / seconds;
+    }
+    printf("  jobs %u workers, %u sleeping, %llu queued, %llu executed (%.0f/s)\n",
+           frame->job_workers, frame->job_sleeping, frame->jobs_queued, frame->jobs_executed, jobs_per_second);
+}
+
+// One column per frame, newest on the right. The scale fits the slowest
+// frame but shows at least twice the budget, the budget is drawn as a
+// line. Frames after an idle wait have no time and stay empty.
+static void view_graph(View *view) {
+    Telemetry_Block *block = &view->block;
+    u32 width = (u32)Min(block->sequence / 2, (u64)VIEW_GRAPH_WIDTH);
+    u32 budget = block->frame.budget_us;
+    u32 scale = budget * 2;
+    for (u32 i = 0; i < width; ++i) {
+        scale = Max(scale, view_history(block, i));
+    }
+    if (!scale) scale = 1;
+
+    u32 budget_row = (u32)((u64)budget * VIEW_GRAPH_HEIGHT / scale);
+    for (u32 row = VIEW_GRAPH_HEIGHT; row > 0; --row) {
+        f64 label = (f64)scale * (f64)row / (f64)VIEW_GRAPH_HEIGHT / 1000.0;
+        printf("%7.2f ms |", label);
+        for (u32 column = 0; column < VIEW_GRAPH_WIDTH; ++column) {
+            char c = ' ';
+            if (column + width >= VIEW_GRAPH_WIDTH) {
+                u32 us = view_history(block, VIEW_GRAPH_WIDTH - 1 - column);
+                u32 height = (u32)(((u64)us * VIEW_GRAPH_HEIGHT + scale - 1) / scale);
+                if (height >= row) c = us > budget ? '!' : '#';
+            }
+            if (c == ' ' && row == budget_row) c = '-';
+            putchar(c);
+        }
+        putchar('\n');
+    }
+}
+
+static void view_connect(View *view) {
+    if (view->connected) telemetry_close(&view->telemetry);
+    view->connected = telemetry_connect(&view->telemetry, view->name);
+}
+
+// Nothing here uses the event queue or the input, but platform.h is
+// built with them and they must not see a null platform_state.
+static Platform_State global_platform_state;
+
+int main(int argc, char **argv) {
+    platform_state = &global_platform_state;
+    View view = {0};
+    u32 interval_ms = 500;
+    b32 graph = 0;
+    b32 once = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval_ms = (u32)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--graph") == 0) {
+            graph = 1;
+        } else if (strcmp(argv[i], "--once") == 0) {
+            once = 1;
+        } else if (argv[i][0] != '-' && !view.name) {
+            view.name = argv[i];
+        } else {
+            view.name = 0;
+            break;
+        }
+    }
+    if (!view.name) {
+        fprintf(stderr, "Usage: telemetry_view [--interval MS] [--graph] [--once] <name>\n");
+        return 1;
+    }
+
+    view_connect(&view);
+    view.last_change_ns = platform_get_time_ns();
+    for (;;) {
+        u64 now = platform_get_time_ns();
+        b32 ok = view.connected && telemetry_read(&view.telemetry, &view.block);
+
+        if (graph && !once) printf("\x1b[H\x1b[2J");
+        if (!view.connected) {
+            printf("Waiting for '%s'.\n", view.name);
+        } else if (!ok) {
+            printf("'%s' kept changing while it was read, trying again.\n", view.name);
+        } else {
+            if (view.block.sequence < view.last_sequence) {
+                // The process was restarted.
+                view.last_sequence      = 0;
+                view.last_jobs_executed = 0;
+                view.last_read_ns       = 0;
+            }
+            if (view.block.sequence != view.last_sequence) view.last_change_ns = now;
+            f64 seconds = view.last_read_ns ? (f64)(now - view.last_read_ns) / 1e9 : 0.0;
+            view_print(&view, seconds);
+            if (graph) view_graph(&view);
+            if (view.block.sequence == view.last_sequence) {
+                printf("  no new frames for %.1f s\n", (f64)(now - view.last_change_ns) / 1e9);
+            }
+            view.last_sequence = view.block.sequence;
+            view.last_jobs_executed = view.block.frame.jobs_executed;
+            view.last_read_ns = now;
+        }
+        fflush(stdout);
+        if (once) return ok ? 0 : 1;
+
+        // A block that stopped changing may belong to a process that is
+        // gone, a new one would have created a new block.
+        if (!view.connected || now - view.last_change_ns > VIEW_RECONNECT_NS) {
+            view_connect(&view);
+        }
+        platform_sleep_ns((u64)interval_ms * 1000000);
+    }
+}
@@ -132,6 +132,7 @@ struct UI_Hash_Table {
 typedef struct UI_Font_Data UI_Font_Data;
 struct UI_Font_Data {
     stbtt_packedchar *char_data;
+    u32 num_chars;
     u32 bm_width;
     u32 bm_height;
     u32 texture_id;
@@ -184,6 +185,7 @@ UI_Box *ui_hash_table_get(UI_Hash_Table *table, UI_Key key);
 UI_Box *ui_hash_table_get_cached(UI_Hash_Table *table, UI_Key key);
 Mem_Arena *ui_frame_arena();
 UI_Font_Data ui_font_load(Mem_Arena *arena, char *font_path, f32 font_size);
+UI_Font_Data ui_font_load_from_memory(Mem_Arena *arena, String font_file, f32 font_size);
 
 // +================+
 // | IMPLEMENTATION |
@@ -299,13 +301,21 @@ UI_Box *ui_hash_table_get_cached(UI_Hash_Table *table, UI_Key key) {
 }
 
 UI_Font_Data ui_font_load(Mem_Arena *arena, char *font_path, f32 font_size) {
-    UI_Font_Data font = {0};
+    String font_file = {0};
+    platform_map_file(font_path, Platform_Map_Flag_Will_Need, &font_file);
+    UI_Font_Data font = ui_font_load_from_memory(arena, font_file, font_size);
+    platform_unmap_file(font_file);
+    return font;
+}
 
-    Platform_File font_file;
-    platform_read_entire_file(font_path, &font_file);
+// For font files that were read asynchronously. Has to run on the thread
+// that owns the GL context.
+UI_Font_Data ui_font_load_from_memory(Mem_Arena *arena, String font_file, f32 font_size) {
+    UI_Font_Data font = {0};
 
     u32 num_chars  = 512; // TODO: need more?
     font.char_data = PushData(arena, stbtt_packedchar, num_chars);
+    font.num_chars = num_chars;
     font.bm_width  = 1024;
     font.bm_height = 512;
     
@@ -314,7 +324,7 @@ UI_Font_Data ui_font_load(Mem_Arena *arena, char *font_path, f32 font_size) {
     stbtt_pack_context pc;
     stbtt_PackBegin(&pc, bitmap, font.bm_width, font.bm_height, 0, 1, 0);
     stbtt_PackSetOversampling(&pc, 2, 2); // @Hardcode
-    stbtt_PackFontRange(&pc, font_file.data, 0, scaled_font_size, 32, num_chars - 32, font.char_data + 32);
+    stbtt_PackFontRange(&pc, font_file.str, 0, scaled_font_size, 32, num_chars - 32, font.char_data + 32);
     glGenTextures(1, &font.texture_id);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, font.texture_id);
@@ -323,15 +333,13 @@ UI_Font_Data ui_font_load(Mem_Arena *arena, char *font_path, f32 font_size) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     stbtt_fontinfo font_info;
-    stbtt_InitFont(&font_info, font_file.data, 0);
+    stbtt_InitFont(&font_info, font_file.str, 0);
     s32 ascent, descent, line_gap;
     s32 advance, lsb;
     stbtt_GetFontVMetrics(&font_info, &ascent, &descent, &line_gap);
     stbtt_GetGlyphHMetrics(&font_info, (s32)'a', &advance, &lsb); // @Hardcode: only works for monospaced fonts
     f32 scale_factor = stbtt_ScaleForMappingEmToPixels(&font_info, font_size);
 
-    platform_release_memory(font_file.data, font_file.size);
-
     font.max_advance = scale_factor * advance;
     font.max_ascent  = scale_factor * (ascent + line_gap);
     font.max_descent = scale_factor * descent;
@@ -365,6 +373,7 @@ void ui_begin(UI_State *state, Platform_State *p_state) {
 }
 
 void ui_end() {
+    ProfileBegin("ui_end");
     UI_State *state = global_ui_state;
     UI_Hash_Table *hash_table = &state->hash_table;
 
@@ -378,14 +387,15 @@ void ui_end() {
     }
 
     for(UI_Axis axis = (UI_Axis)0; axis < UI_Axis_Count; axis = (UI_Axis)(axis + 1)) {
-        ui_layout_independent_sizes(global_ui_state->root, axis);
-        ui_layout_upwards_dependent(global_ui_state->root, axis);
-        ui_layout_downwards_dependent(global_ui_state->root, axis);
-        ui_layout_enforce_constraints(global_ui_state->root, axis);
-        ui_layout_position(global_ui_state->root, axis);
+        ProfileScope("ui_layout_independent_sizes")   ui_layout_independent_sizes(global_ui_state->root, axis);
+        ProfileScope("ui_layout_upwards_dependent")   ui_layout_upwards_dependent(global_ui_state->root, axis);
+        ProfileScope("ui_layout_downwards_dependent") ui_layout_downwards_dependent(global_ui_state->root, axis);
+        ProfileScope("ui_layout_enforce_constraints") ui_layout_enforce_constraints(global_ui_state->root, axis);
+        ProfileScope("ui_layout_position")            ui_layout_position(global_ui_state->root, axis);
     }
 
     global_ui_state->current_frame += 1;
+    ProfileEnd();
 }
 
 UI_Size ui_pixel_size(f32 pixels) {
@@ -457,7 +467,8 @@ void ui_layout_independent_sizes(UI_Box *box, UI_Axis axis) {
         case UI_Size_Kind_Text_Content: {
             f32 padding = box->size[axis].value;
             if (axis == UI_Axis_X) {
-                box->fixed_size.data[axis] = box->text.size * global_ui_state->font.max_advance + padding;
+                u64 num_codepoints = str_utf8_count_codepoints(box->text);
+                box->fixed_size.data[axis] = num_codepoints * global_ui_state->font.max_advance + padding;
             } else if (axis == UI_Axis_Y) {
                 box->fixed_size.data[axis] = global_ui_state->font.max_height + padding;
             }
@@ -644,8 +655,12 @@ void ui_render_box(UI_Box *box) {
         f32 x = rect->p0.x + (box->size[UI_Axis_X].value / 2);
         f32 y = rect->p1.y + font->max_descent - (box->size[UI_Axis_Y].value / 2);
         // TODO: Get the actual display text
-        for (u64 i = 0; i < box->text.size; ++i) {
-            stbtt_GetPackedQuad(font->char_data, font->bm_width, font->bm_height, box->text.str[i], &x, &y, &q, 0);
+        for (u64 i = 0; i < box->text.size;) {
+            Unicode_Decode decode = str_utf8_decode(box->text.str + i, box->text.size - i);
+            i += decode.advance;
+            u32 codepoint = decode.codepoint;
+            if (codepoint < 32 || codepoint >= font->num_chars) codepoint = '?';
+            stbtt_GetPackedQuad(font->char_data, font->bm_width, font->bm_height, codepoint, &x, &y, &q, 0);
             glColor3f(text.x, text.y, text.z);
             glEnable(GL_TEXTURE_2D);
             glBindTexture(GL_TEXTURE_2D, font->texture_id);
@@ -702,7 +717,9 @@ void ui_render_tree_recursive(UI_Box *box) {
 
 void ui_render(UI_State *state) {
     //platform_log("TREE BEGIN\n");
+    ProfileBegin("ui_render");
     ui_render_tree_recursive(state->root);
+    ProfileEnd();
 }
 
 #endif
@@ -5,9 +5,7 @@ static Platform_State global_platform_state;
 static HDC            global_window_dc;
 static HGLRC          global_opengl_rc;
 static b32            tracking_mouse = 0;
-static s64            perf_count_frequency;
-static LARGE_INTEGER  last_counter;
-static LARGE_INTEGER  end_counter;
+static u16            pending_high_surrogate = 0;
 
 
 
@@ -34,7 +32,7 @@ void platform_decommit_memory(void *mem, u64 size) {
 
 
 b32 platform_read_entire_file(char *file_name, Platform_File *result) {
-    HANDLE file_handle = CreateFileA(file_name, GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    HANDLE file_handle = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
     if (file_handle == INVALID_HANDLE_VALUE) {
         return 0;
     }
@@ -43,11 +41,21 @@ b32 platform_read_entire_file(char *file_name, Platform_File *result) {
     GetFileSizeEx(file_handle, &file_size);
     result->size = file_size.QuadPart;
     result->data = (u8 *)VirtualAlloc(0, result->size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-    DWORD bytes_read = 0;
-    ReadFile(file_handle, result->data, (u32)result->size, &bytes_read, 0);
+
+    // ReadFile takes a 32-bit size, so larger files are read in pieces.
+    u64 total_read = 0;
+    while (total_read < result->size) {
+        u64 remaining = result->size - total_read;
+        DWORD to_read = remaining > GB(1) ? (DWORD)GB(1) : (DWORD)remaining;
+        DWORD bytes_read = 0;
+        if (!ReadFile(file_handle, result->data + total_read, to_read, &bytes_read, 0) || bytes_read == 0) {
+            break;
+        }
+        total_read += bytes_read;
+    }
     CloseHandle(file_handle);
 
-    if (result->size == bytes_read) {
+    if (result->size == total_read) {
         return 1;
     } else {
         platform_release_memory(result->data, result->size);
@@ -55,6 +63,532 @@ b32 platform_read_entire_file(char *file_name, Platform_File *result) {
     }
 }
 
+b32 platform_map_file(char *file_name, Platform_Map_Flags flags, String *result) {
+    DWORD file_flags = FILE_ATTRIBUTE_NORMAL;
+    if (flags & Platform_Map_Flag_Sequential) file_flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+
+    HANDLE file_handle = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, file_flags, 0);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file_handle, &file_size);
+    result->size = file_size.QuadPart;
+    result->str  = 0;
+
+    // Empty files cannot be mapped, but a view is not needed for them anyway.
+    if (result->size > 0) {
+        HANDLE mapping = CreateFileMappingA(file_handle, 0, PAGE_READONLY, 0, 0, 0);
+        if (mapping) {
+            result->str = (u8 *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            // The view keeps the mapping alive.
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file_handle);
+
+    if (result->size > 0 && !result->str) {
+        Platform_File file;
+        if (!platform_read_entire_file(file_name, &file)) {
+            return 0;
+        }
+        result->str  = file.data;
+        result->size = file.size;
+    } else if (result->str && (flags & Platform_Map_Flag_Will_Need)) {
+        WIN32_MEMORY_RANGE_ENTRY range = {0};
+        range.VirtualAddress = result->str;
+        range.NumberOfBytes  = result->size;
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+    return 1;
+}
+
+void platform_unmap_file(String mapping) {
+    if (!mapping.str) return;
+    // Memory from the buffered fallback is not a view.
+    if (!UnmapViewOfFile(mapping.str)) {
+        platform_release_memory(mapping.str, mapping.size);
+    }
+}
+
+// =========================
+// >> Files
+
+static HANDLE global_io_completion_port;
+
+static HANDLE win32_get_io_completion_port() {
+    if (!global_io_completion_port) {
+        HANDLE port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, 1);
+        if (InterlockedCompareExchangePointer(&global_io_completion_port, port, 0) != 0) {
+            CloseHandle(port);
+        }
+    }
+    return global_io_completion_port;
+}
+
+Platform_File_Handle platform_open_file(char *file_name, Platform_File_Flags flags) {
+    DWORD access = 0;
+    if (flags & Platform_File_Flag_Read)  access |= GENERIC_READ;
+    if (flags & Platform_File_Flag_Write) access |= GENERIC_WRITE;
+
+    DWORD creation = OPEN_EXISTING;
+    if ((flags & Platform_File_Flag_Create) && (flags & Platform_File_Flag_Truncate)) {
+        creation = CREATE_ALWAYS;
+    } else if (flags & Platform_File_Flag_Create) {
+        creation = OPEN_ALWAYS;
+    } else if (flags & Platform_File_Flag_Truncate) {
+        creation = TRUNCATE_EXISTING;
+    }
+
+    // Handles are always opened for overlapped I/O and attached to the
+    // completion port, all transfers go through platform_async_io_*.
+    HANDLE handle = CreateFileA(file_name, access, FILE_SHARE_READ, 0, creation, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, 0);
+    if (handle != INVALID_HANDLE_VALUE) {
+        CreateIoCompletionPort(handle, win32_get_io_completion_port(), 0, 0);
+    }
+
+    Platform_File_Handle result;
+    result.value = (u64)handle;
+    return result;
+}
+
+void platform_close_file(Platform_File_Handle file) {
+    if (platform_file_handle_is_valid(file)) {
+        CloseHandle((HANDLE)file.value);
+    }
+}
+
+u64 platform_get_file_size(Platform_File_Handle file) {
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx((HANDLE)file.value, &file_size)) {
+        return 0;
+    }
+    return file_size.QuadPart;
+}
+
+b32 platform_flush_file(Platform_File_Handle file) {
+    return FlushFileBuffers((HANDLE)file.value) != 0;
+}
+
+// Replaces new_name atomically if it exists.
+b32 platform_rename_file(char *old_name, char *new_name) {
+    return MoveFileExA(old_name, new_name, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+b32 platform_delete_file(char *file_name) {
+    return DeleteFileA(file_name) != 0;
+}
+
+b32 platform_set_file_size(Platform_File_Handle file, u64 size) {
+    FILE_END_OF_FILE_INFO info;
+    info.EndOfFile.QuadPart = size;
+    return SetFileInformationByHandle((HANDLE)file.value, FileEndOfFileInfo, &info, sizeof(info)) != 0;
+}
+
+// A read-write view of [offset, offset + size), the file grows to fit.
+// The file has to be opened for reading and writing.
+void *platform_map_file_view(Platform_File_Handle file, u64 offset, u64 size) {
+    u64 end = offset + size;
+    HANDLE mapping = CreateFileMappingA((HANDLE)file.value, 0, PAGE_READWRITE, (DWORD)(end >> 32), (DWORD)end, 0);
+    if (!mapping) return 0;
+    void *view = MapViewOfFile(mapping, FILE_MAP_WRITE, (DWORD)(offset >> 32), (DWORD)offset, size);
+    // The view keeps the mapping alive.
+    CloseHandle(mapping);
+    return view;
+}
+
+void platform_unmap_file_view(void *view, u64 size) {
+    if (view) UnmapViewOfFile(view);
+}
+
+// Writes the buffers back to back starting at offset, blocking until all
+// of them are written. WriteFileGather only takes whole pages of files
+// opened without buffering, so the buffers are written one after the
+// other instead. The low bit of the event keeps these writes off the
+// completion port.
+b32 platform_write_file_gather(Platform_File_Handle file, u64 offset, String *buffers, u32 count) {
+    HANDLE event = CreateEventA(0, TRUE, FALSE, 0);
+    if (!event) return 0;
+
+    HANDLE handle = (HANDLE)file.value;
+    b32 ok = 1;
+    for (u32 i = 0; i < count && ok; ++i) {
+        u8 *data = buffers[i].str;
+        u64 remaining = buffers[i].size;
+        while (remaining > 0 && ok) {
+            DWORD size = remaining > GB(1) ? (DWORD)GB(1) : (DWORD)remaining;
+            OVERLAPPED overlapped = {0};
+            overlapped.Offset     = (DWORD)offset;
+            overlapped.OffsetHigh = (DWORD)(offset >> 32);
+            overlapped.hEvent     = (HANDLE)((uintptr_t)event | 1);
+
+            DWORD written = 0;
+            if (!WriteFile(handle, data, size, 0, &overlapped) && GetLastError() != ERROR_IO_PENDING) {
+                ok = 0;
+            } else if (!GetOverlappedResult(handle, &overlapped, &written, TRUE) || written == 0) {
+                ok = 0;
+            }
+            data      += written;
+            offset    += written;
+            remaining -= written;
+        }
+    }
+    CloseHandle(event);
+    return ok;
+}
+
+
+// =========================
+// >> Shared memory
+//
+// The mapping object lives as long as a view of it does, so the handles
+// are closed right away.
+
+// Fails if another process already created a region of that name.
+b32 platform_create_shared_memory(char *name, u64 size, Platform_Shared_Memory *result) {
+    memset(result, 0, sizeof(*result));
+    snprintf(result->name, sizeof(result->name), "Local\\%s", name);
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, result->name);
+    if (!mapping) return 0;
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        CloseHandle(mapping);
+        return 0;
+    }
+    void *data = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+    CloseHandle(mapping);
+    if (!data) return 0;
+    result->data  = data;
+    result->size  = size;
+    result->owner = 1;
+    return 1;
+}
+
+// Maps a region of another process read-only, the size may be rounded
+// up to whole pages.
+b32 platform_open_shared_memory(char *name, Platform_Shared_Memory *result) {
+    memset(result, 0, sizeof(*result));
+    snprintf(result->name, sizeof(result->name), "Local\\%s", name);
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, result->name);
+    if (!mapping) return 0;
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data) return 0;
+
+    MEMORY_BASIC_INFORMATION info;
+    VirtualQuery(data, &info, sizeof(info));
+    result->data = data;
+    result->size = info.RegionSize;
+    return 1;
+}
+
+void platform_close_shared_memory(Platform_Shared_Memory *memory) {
+    if (memory->data) UnmapViewOfFile(memory->data);
+    memset(memory, 0, sizeof(*memory));
+}
+
+
+// =========================
+// >> Asynchronous I/O
+//
+// Overlapped reads and writes that complete on the I/O completion port.
+// The OVERLAPPED lives at the start of Platform_Async_IO.backend. Requests
+// that finish without reaching the kernel are posted to the port with a
+// completion key other than 0, so everything is dispatched in one place.
+
+#define WIN32_ASYNC_IO_KEY_KERNEL 0
+#define WIN32_ASYNC_IO_KEY_OK     1
+#define WIN32_ASYNC_IO_KEY_FAILED 2
+
+static void win32_async_io_start(Platform_Async_IO *io) {
+    OVERLAPPED *overlapped = (OVERLAPPED *)io->backend;
+    memset(overlapped, 0, sizeof(OVERLAPPED));
+
+    u64 offset = io->offset + io->bytes_transferred;
+    overlapped->Offset     = (DWORD)offset;
+    overlapped->OffsetHigh = (DWORD)(offset >> 32);
+
+    // ReadFile/WriteFile take 32-bit sizes, larger requests are split.
+    u64 remaining = io->size - io->bytes_transferred;
+    DWORD size = remaining > GB(1) ? (DWORD)GB(1) : (DWORD)remaining;
+    u8 *buffer = io->buffer + io->bytes_transferred;
+
+    HANDLE handle = (HANDLE)io->file.value;
+    BOOL ok = 0;
+    if (io->op == Platform_Async_IO_Op_Read) {
+        ok = ReadFile(handle, buffer, size, 0, overlapped);
+    } else {
+        ok = WriteFile(handle, buffer, size, 0, overlapped);
+    }
+
+    if (!ok) {
+        DWORD error = GetLastError();
+        if (error == ERROR_HANDLE_EOF) {
+            PostQueuedCompletionStatus(win32_get_io_completion_port(), 0, WIN32_ASYNC_IO_KEY_OK, overlapped);
+        } else if (error != ERROR_IO_PENDING) {
+            PostQueuedCompletionStatus(win32_get_io_completion_port(), 0, WIN32_ASYNC_IO_KEY_FAILED, overlapped);
+        }
+    }
+}
+
+void platform_async_io_submit(Platform_Async_IO *io) {
+    io->state = Platform_Async_IO_State_Pending;
+    io->bytes_transferred = 0;
+    if (io->size == 0) {
+        PostQueuedCompletionStatus(win32_get_io_completion_port(), 0, WIN32_ASYNC_IO_KEY_OK, (OVERLAPPED *)io->backend);
+    } else {
+        win32_async_io_start(io);
+    }
+}
+
+static u32 win32_async_io_process(b32 block) {
+    OVERLAPPED_ENTRY entries[64];
+    ULONG count = 0;
+    if (!GetQueuedCompletionStatusEx(win32_get_io_completion_port(), entries, ArrayCount(entries), &count, block ? INFINITE : 0, FALSE)) {
+        return 0;
+    }
+
+    u32 completed = 0;
+    for (ULONG i = 0; i < count; ++i) {
+        OVERLAPPED *overlapped = entries[i].lpOverlapped;
+        Platform_Async_IO *io = (Platform_Async_IO *)((u8 *)overlapped - offsetof(Platform_Async_IO, backend));
+        ULONG_PTR key = entries[i].lpCompletionKey;
+
+        b32 ok = key != WIN32_ASYNC_IO_KEY_FAILED;
+        b32 finished = key != WIN32_ASYNC_IO_KEY_KERNEL;
+        if (key == WIN32_ASYNC_IO_KEY_KERNEL) {
+            DWORD bytes = 0;
+            if (GetOverlappedResult((HANDLE)io->file.value, overlapped, &bytes, FALSE)) {
+                io->bytes_transferred += bytes;
+                finished = bytes == 0 || io->bytes_transferred >= io->size;
+                ok = bytes > 0 || io->op == Platform_Async_IO_Op_Read;
+            } else {
+                // Reading past the end is not an error, just a short read.
+                finished = 1;
+                ok = GetLastError() == ERROR_HANDLE_EOF;
+            }
+        }
+
+        if (!finished) {
+            win32_async_io_start(io);
+            continue;
+        }
+        io->state = ok ? Platform_Async_IO_State_Done : Platform_Async_IO_State_Failed;
+        if (io->callback) io->callback(io);
+        completed += 1;
+    }
+    return completed;
+}
+
+u32 platform_async_io_poll() {
+    return win32_async_io_process(0);
+}
+
+void platform_async_io_wait(Platform_Async_IO *io) {
+    while (io->state == Platform_Async_IO_State_Pending) {
+        win32_async_io_process(1);
+    }
+}
+
+// =========================
+// >> Threads
+
+typedef HRESULT WINAPI Win32_Set_Thread_Description(HANDLE thread, PCWSTR description);
+
+typedef struct Win32_Thread_Start Win32_Thread_Start;
+struct Win32_Thread_Start {
+    Platform_Thread_Proc *proc;
+    void *data;
+    char *name;
+    Platform_Thread_Event started;
+};
+
+static DWORD WINAPI win32_thread_proc(LPVOID param) {
+    Win32_Thread_Start *start = (Win32_Thread_Start *)param;
+    Platform_Thread_Proc *proc = start->proc;
+    void *data = start->data;
+    if (start->name) {
+        // SetThreadDescription only exists since Windows 10 1607.
+        Win32_Set_Thread_Description *set_thread_description = (Win32_Set_Thread_Description *)
+            GetProcAddress(GetModuleHandleA("kernel32.dll"), "SetThreadDescription");
+        if (set_thread_description) {
+            WCHAR name[64];
+            MultiByteToWideChar(CP_UTF8, 0, start->name, -1, name, ArrayCount(name));
+            name[ArrayCount(name) - 1] = 0;
+            set_thread_description(GetCurrentThread(), name);
+        }
+    }
+    // start lives on the creating thread's stack, it is gone after this.
+    platform_thread_event_set(&start->started);
+    proc(data);
+    return 0;
+}
+
+Platform_Thread platform_thread_create(Platform_Thread_Proc *proc, void *data, char *name) {
+    Platform_Thread result = {0};
+    Win32_Thread_Start start = {0};
+    start.proc = proc;
+    start.data = data;
+    start.name = name;
+
+    HANDLE thread = CreateThread(0, 0, win32_thread_proc, &start, 0, 0);
+    if (!thread) {
+        platform_log("Failed to create thread '%s'.\n", name ? name : "");
+        return result;
+    }
+    platform_thread_event_wait(&start.started);
+    result.handle = (u64)thread;
+    return result;
+}
+
+void platform_thread_join(Platform_Thread thread) {
+    if (thread.handle) {
+        WaitForSingleObject((HANDLE)thread.handle, INFINITE);
+        CloseHandle((HANDLE)thread.handle);
+    }
+}
+
+void platform_thread_set_affinity(Platform_Thread thread, u32 core) {
+    if (core < 64) SetThreadAffinityMask((HANDLE)thread.handle, (DWORD_PTR)1 << core);
+}
+
+u32 platform_get_thread_id() {
+    return (u32)GetCurrentThreadId();
+}
+
+u32 platform_get_core_count() {
+    DWORD count = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    return count ? (u32)count : 1;
+}
+
+void platform_thread_yield() {
+    SwitchToThread();
+}
+
+static Platform_Crash_Proc *global_crash_proc;
+
+static LONG WINAPI win32_unhandled_exception_filter(EXCEPTION_POINTERS *exception) {
+    Platform_Crash_Proc *proc = global_crash_proc;
+    global_crash_proc = 0;
+    if (proc) proc();
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+
+void platform_set_crash_handler(Platform_Crash_Proc *proc) {
+    global_crash_proc = proc;
+    SetUnhandledExceptionFilter(proc ? win32_unhandled_exception_filter : 0);
+}
+
+void platform_futex_wait(volatile u32 *address, u32 expected) {
+    WaitOnAddress(address, &expected, sizeof(expected), INFINITE);
+}
+
+// Returns 0 on timeout.
+b32 platform_futex_wait_timeout(volatile u32 *address, u32 expected, u32 timeout_ms) {
+    if (WaitOnAddress(address, &expected, sizeof(expected), timeout_ms)) return 1;
+    return GetLastError() != ERROR_TIMEOUT;
+}
+
+void platform_futex_wake(volatile u32 *address, b32 wake_all) {
+    if (wake_all) {
+        WakeByAddressAll((PVOID)address);
+    } else {
+        WakeByAddressSingle((PVOID)address);
+    }
+}
+
+// =========================
+// >> Time
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+static ThreadLocal HANDLE win32_sleep_timer;
+static u64 win32_perf_frequency;
+
+// The frequency is fixed at boot, so threads racing on the first call
+// all store the same value.
+u64 platform_get_time_ns() {
+    u64 frequency = win32_perf_frequency;
+    if (!frequency) {
+        LARGE_INTEGER frequency_result;
+        QueryPerformanceFrequency(&frequency_result);
+        frequency = (u64)frequency_result.QuadPart;
+        win32_perf_frequency = frequency;
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    u64 ticks = (u64)counter.QuadPart;
+    return (ticks / frequency) * 1000000000ull + (ticks % frequency) * 1000000000ull / frequency;
+}
+
+// Sleep() only wakes on the scheduler tick of up to 15.6ms, the high
+// resolution waitable timer (Windows 10 1803+) is accurate to well below
+// a millisecond.
+void platform_sleep_ns(u64 duration) {
+    if (!win32_sleep_timer) {
+        win32_sleep_timer = CreateWaitableTimerExW(0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (!win32_sleep_timer) win32_sleep_timer = INVALID_HANDLE_VALUE;
+    }
+    if (win32_sleep_timer != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER due_time;
+        due_time.QuadPart = -(s64)(duration / 100); // Relative, in 100ns.
+        if (SetWaitableTimer(win32_sleep_timer, &due_time, 0, 0, 0, 0)) {
+            WaitForSingleObject(win32_sleep_timer, INFINITE);
+            return;
+        }
+    }
+    Sleep((DWORD)(duration / 1000000));
+}
+
+// =========================
+// >> Fibers
+//
+// Windows fibers already reserve their stack and commit it on demand
+// behind a guard page, so the stack is not allocated by hand here.
+
+static void WINAPI win32_fiber_proc(LPVOID param) {
+    Platform_Fiber *fiber = (Platform_Fiber *)param;
+    fiber->proc(fiber->data);
+    platform_log("Fiber proc returned, fibers have to switch away instead.\n");
+    ExitProcess(1);
+}
+
+b32 platform_fiber_init(Platform_Fiber *fiber, Platform_Fiber_Proc *proc, void *data, u64 stack_size) {
+    memset(fiber, 0, sizeof(*fiber));
+    fiber->proc = proc;
+    fiber->data = data;
+    fiber->stack_size = stack_size;
+    fiber->context = CreateFiberEx(KB(64), (SIZE_T)stack_size, FIBER_FLAG_FLOAT_SWITCH, win32_fiber_proc, fiber);
+    return fiber->context != 0;
+}
+
+void platform_fiber_init_from_thread(Platform_Fiber *fiber) {
+    memset(fiber, 0, sizeof(*fiber));
+    fiber->is_thread = 1;
+    if (IsThreadAFiber()) {
+        fiber->context = GetCurrentFiber();
+    } else {
+        fiber->context = ConvertThreadToFiberEx(0, FIBER_FLAG_FLOAT_SWITCH);
+        fiber->converted_thread = 1;
+    }
+}
+
+void platform_fiber_release(Platform_Fiber *fiber) {
+    if (fiber->converted_thread) {
+        ConvertFiberToThread();
+    } else if (!fiber->is_thread && fiber->context) {
+        DeleteFiber(fiber->context);
+    }
+    memset(fiber, 0, sizeof(*fiber));
+}
+
+void platform_fiber_switch(Platform_Fiber *from, Platform_Fiber *to) {
+    (void)from;
+    SwitchToFiber(to->context);
+}
+
 void platform_log(char *format, ...) {
     char buffer[1024];
     va_list args;
@@ -64,6 +598,45 @@ void platform_log(char *format, ...) {
     va_end(args);
 }
 
+// =========================
+// >> Keys
+
+// Virtual-key code -> Key, filled from key_list.inc.
+static Key win32_key_table[256];
+
+static void win32_init_key_table() {
+    for (s32 i = 0; i < ArrayCount(win32_key_table); ++i) {
+        win32_key_table[i] = KEY_UNKNOWN;
+    }
+#define Key(name, str, win32, mac, x11) if ((win32) >= 0) win32_key_table[(win32)] = KEY_##name;
+#include "../key_list.inc"
+#undef Key
+}
+
+static Key win32_translate_key(WPARAM vk_code) {
+    return vk_code < ArrayCount(win32_key_table) ? win32_key_table[vk_code] : KEY_UNKNOWN;
+}
+
+// Every held modifier counts, Ctrl+Shift is both bits.
+static Key_Modifiers win32_get_modifiers() {
+    Key_Modifiers key_modifiers = 0;
+    if (GetKeyState(VK_CONTROL) & 0x8000) key_modifiers |= KEY_MODIFIER_CTRL;
+    if (GetKeyState(VK_SHIFT) & 0x8000)   key_modifiers |= KEY_MODIFIER_SHIFT;
+    if (GetKeyState(VK_MENU) & 0x8000)    key_modifiers |= KEY_MODIFIER_ALT;
+    return key_modifiers;
+}
+
+static void win32_push_character(u32 character) {
+    if (character < 32) return;
+    Platform_Event event = {0};
+    {
+        event.type          = Platform_Event_Type_Character_Input;
+        event.character     = character;
+        event.key_modifiers = win32_get_modifiers();
+    }
+    platform_push_event(event);
+}
+
 static ivec2 win32_get_mouse_pos(HWND window)
 {
     ivec2 result = {0};
@@ -75,53 +648,76 @@ static ivec2 win32_get_mouse_pos(HWND window)
     return result;
 }
 
-static void win32_process_pending_messages() {
+// =========================
+// >> Message pump
+//
+// The window is created and its messages are pumped on a thread of its
+// own, so input is queued as soon as it arrives and the modal loops of
+// moving and resizing do not stall the frame loop. Rendering and
+// app_update stay on the main thread.
+
+typedef struct Win32_Message_Thread Win32_Message_Thread;
+struct Win32_Message_Thread {
+    HINSTANCE instance;
+    char *class_name;
+    HWND window;
+    u32 thread_id;
+    Platform_Thread_Event window_created;
+};
+
+static void win32_message_thread_proc(void *data) {
+    Win32_Message_Thread *message_thread = (Win32_Message_Thread *)data;
+    message_thread->thread_id = platform_get_thread_id();
+    message_thread->window = CreateWindowA(message_thread->class_name,
+                                           "app",
+                                           WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                                           CW_USEDEFAULT, CW_USEDEFAULT,
+                                           platform_state->window_width, platform_state->window_height,
+                                           0, 0, message_thread->instance, 0);
+    HWND window = message_thread->window;
+    platform_thread_event_set(&message_thread->window_created);
+    if (window == 0) return;
+
+    // Runs until the main thread posts WM_QUIT.
     MSG message;
-    while (PeekMessage(&message, 0, 0, 0, PM_REMOVE)) {
+    while (GetMessageA(&message, 0, 0, 0) > 0) {
         TranslateMessage(&message);
         DispatchMessageA(&message);
     }
+    DestroyWindow(window);
 }
 
-static void update_delta_time() {
-        QueryPerformanceCounter(&end_counter);
-        s64 counter_elapsed = end_counter.QuadPart - last_counter.QuadPart;
-        platform_state->delta = (f32)counter_elapsed / (f32)perf_count_frequency;
-        last_counter = end_counter;
+static void win32_update_viewport(s32 *width, s32 *height) {
+    s32 window_width  = platform_state->window_width;
+    s32 window_height = platform_state->window_height;
+    if (window_width != *width || window_height != *height) {
+        *width  = window_width;
+        *height = window_height;
+        glViewport(0, 0, window_width, window_height);
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(0.0f, (f32)window_width, (f32)window_height, 0.0f, 0.0f, 1.0f);
+    }
 }
 
 LRESULT CALLBACK win32_window_proc(HWND window, UINT message, WPARAM wparam, LPARAM lparam) {
     LRESULT result = 0;
 
-    Key_Modifiers key_modifiers = 0;
-    if (GetKeyState(VK_CONTROL) & 0x8000) {
-        key_modifiers |= KEY_MODIFIER_CTRL;
-    } else if (GetKeyState(VK_SHIFT) & 0x8000) {
-        key_modifiers |= KEY_MODIFIER_SHIFT;
-    } else if (GetKeyState(VK_MENU) & 0x8000) {
-        key_modifiers |= KEY_MODIFIER_ALT;
-    }
-
     switch (message) {
         
         case WM_SIZE: {
+            // The GL context belongs to the main thread, it picks the new
+            // size up at the start of the next frame.
             platform_state->window_width  = LOWORD(lparam);
             platform_state->window_height = HIWORD(lparam);
-            glViewport(0, 0, platform_state->window_width, platform_state->window_height);
-            glMatrixMode(GL_PROJECTION);
-            glLoadIdentity();
-            glOrtho(0.0f, (f32)platform_state->window_width, (f32)platform_state->window_height, 0.0f, 0.0f, 1.0f);
-            if (app_data) {
-                update_delta_time();
-                app_update();
-            }
-            PostMessage(window, WM_PAINT, 0, 0);
+            platform_request_frame();
         } break;
 
         case WM_QUIT:
         case WM_DESTROY:
         case WM_CLOSE: {
-            platform_state->running = 0;
+            atomic_store_u32(&platform_state->running, 0);
+            platform_request_frame();
         } break;
 
                 case WM_LBUTTONDOWN: {
@@ -129,7 +725,7 @@ LRESULT CALLBACK win32_window_proc(HWND window, UINT message, WPARAM wparam, LPA
             {
                 event.type          = Platform_Event_Type_Mouse_Press;
                 event.key           = KEY_MOUSE_BUTTON_LEFT;
-                event.key_modifiers = key_modifiers;
+                event.key_modifiers = win32_get_modifiers();
             }
             platform_push_event(event);
         } break;
@@ -139,7 +735,7 @@ LRESULT CALLBACK win32_window_proc(HWND window, UINT message, WPARAM wparam, LPA
             {
                 event.type          = Platform_Event_Type_Mouse_Release;
                 event.key           = KEY_MOUSE_BUTTON_LEFT;
-                event.key_modifiers = key_modifiers;
+                event.key_modifiers = win32_get_modifiers();
             }
             platform_push_event(event);
         } break;
@@ -149,7 +745,7 @@ LRESULT CALLBACK win32_window_proc(HWND window, UINT message, WPARAM wparam, LPA
             {
                 event.type          = Platform_Event_Type_Mouse_Press;
                 event.key           = KEY_MOUSE_BUTTON_RIGHT;
-                event.key_modifiers = key_modifiers;
+                event.key_modifiers = win32_get_modifiers();
             }
             platform_push_event(event);
         } break;
@@ -159,7 +755,7 @@ LRESULT CALLBACK win32_window_proc(HWND window, UINT message, WPARAM wparam, LPA
             {
                 event.type          = Platform_Event_Type_Mouse_Release;
                 event.key           = KEY_MOUSE_BUTTON_RIGHT;
-                event.key_modifiers = key_modifiers;
+                event.key_modifiers = win32_get_modifiers();
             }
             platform_push_event(event);
         } break;
@@ -214,100 +810,15 @@ LRESULT CALLBACK win32_window_proc(HWND window, UINT message, WPARAM wparam, LPA
         case WM_SYSKEYUP:
         case WM_KEYDOWN:
         case WM_KEYUP: {
-            s32 vk_code = (s32)wparam;
             b32 is_down = (lparam & (1 << 31)) == 0;
 
-            s32 key_input = 0;
-            if (vk_code >= 'A' && vk_code <= 'Z') {
-                key_input = KEY_A + (vk_code - 'A');
-            } else if (vk_code >= '0' && vk_code <= '9') {
-                key_input = KEY_0 + (vk_code - '0');
-            } else {
-                if (vk_code == VK_BACK) {
-                    key_input = KEY_BACKSPACE;
-                } else if (vk_code == VK_TAB) {
-                    key_input = KEY_TAB;
-                } else if (vk_code == VK_RETURN) {
-                    key_input = KEY_ENTER;
-                } else if (vk_code == VK_SHIFT) {
-                    key_input = KEY_SHIFT;
-                } else if (vk_code == VK_CONTROL) {
-                    key_input = KEY_CTRL;
-                    key_modifiers &= ~KEY_MODIFIER_CTRL;
-                } else if (vk_code == VK_MENU) {
-                    key_input = KEY_ALT;
-                    key_modifiers &= ~KEY_MODIFIER_ALT;
-                } else if (vk_code == VK_PAUSE) {
-                    key_input = KEY_PAUSE;
-                } else if (vk_code == VK_CAPITAL) {
-                    key_input = KEY_CAPS_LOCK;
-                } else if (vk_code == VK_ESCAPE) {
-                    key_input = KEY_ESCAPE;
-                } else if (vk_code == VK_SPACE) {
-                    key_input = KEY_SPACE;
-                } else if (vk_code == VK_PRIOR) {
-                    key_input = KEY_PAGE_UP;
-                } else if (vk_code == VK_NEXT) {
-                    key_input = KEY_PAGE_DOWN;
-                } else if (vk_code == VK_END) {
-                    key_input = KEY_END;
-                } else if (vk_code == VK_HOME) {
-                    key_input = KEY_HOME;
-                } else if (vk_code == VK_LEFT) {
-                    key_input = KEY_LEFT;
-                } else if (vk_code == VK_RIGHT) {
-                    key_input = KEY_RIGHT;
-                } else if (vk_code == VK_UP) {
-                    key_input = KEY_UP;
-                } else if (vk_code == VK_DOWN) {
-                    key_input = KEY_DOWN;
-                } else if (vk_code == VK_SNAPSHOT) {
-                    key_input = KEY_PRINT_SCREEN;
-                } else if (vk_code == VK_INSERT) {
-                    key_input = KEY_INSERT;
-                } else if (vk_code == VK_DELETE) {
-                    key_input = KEY_DELETE;
-                }  else if (vk_code >= VK_F1 && vk_code <= VK_F12) {
-                    key_input = KEY_F1 + (vk_code - VK_F1);
-                } else if (vk_code == VK_SCROLL) {
-                    key_input = KEY_SCROLL_LOCK;
-                } else if (vk_code == VK_OEM_1) {
-                    key_input = KEY_SEMICOLON;
-                } else if (vk_code == VK_OEM_PLUS) {
-                    key_input = KEY_PLUS;
-                } else if (vk_code == VK_OEM_MINUS) {
-                    key_input = KEY_MINUS;
-                } else if (vk_code == VK_OEM_PERIOD) {
-                    key_input = KEY_PERIOD;
-                } else if (vk_code == VK_OEM_2) {
-                    key_input = KEY_SLASH;
-                } else if (vk_code == VK_OEM_3) {
-                    key_input = KEY_GRAVE_ACCENT;
-                } else if (vk_code == VK_OEM_4) {
-                    key_input = KEY_LEFT_BRACKET;
-                } else if (vk_code == VK_OEM_5) {
-                    key_input = KEY_BACKSLASH;
-                } else if (vk_code == VK_OEM_6) {
-                    key_input = KEY_RIGHT_BRACKET;
-                } else if (vk_code == VK_OEM_7) {
-                    key_input = KEY_QUOTE;
-                }
-            }
-
-            if (is_down) {
-                Platform_Event event = {0};
-                {
-                    event.type          = Platform_Event_Type_Key_Press;
-                    event.key           = key_input;
-                    event.key_modifiers = key_modifiers;
-                }
-                platform_push_event(event);
-            } else {
+            Key key = win32_translate_key(wparam);
+            if (key != KEY_UNKNOWN) {
                 Platform_Event event = {0};
                 {
-                    event.type          = Platform_Event_Type_Key_Release;
-                    event.key           = key_input;
-                    event.key_modifiers = key_modifiers;
+                    event.type          = is_down ? Platform_Event_Type_Key_Press : Platform_Event_Type_Key_Release;
+                    event.key           = key;
+                    event.key_modifiers = key_event_modifiers(key, win32_get_modifiers());
                 }
                 platform_push_event(event);
             }
@@ -316,15 +827,22 @@ LRESULT CALLBACK win32_window_proc(HWND window, UINT message, WPARAM wparam, LPA
         } break;
 
         case WM_CHAR: {
-            s32 character = (s32)wparam;
-            if (character >= 32) {
-                Platform_Event event = {0};
-                {
-                    event.type          = Platform_Event_Type_Character_Input;
-                    event.character     = character;
-                    event.key_modifiers = key_modifiers;
+            // WM_CHAR delivers UTF-16 code units, so codepoints outside the
+            // BMP arrive as two messages that have to be recombined. A high
+            // surrogate without its low one becomes U+FFFD, the unit after
+            // it still counts on its own.
+            u16 units[2] = { pending_high_surrogate, (u16)wparam };
+            pending_high_surrogate = 0;
+            u16 *at = units[0] ? units : units + 1;
+            u16 *end = units + 2;
+            while (at < end) {
+                if (at + 1 == end && *at >= 0xD800 && *at <= 0xDBFF) {
+                    pending_high_surrogate = *at;
+                    break;
                 }
-                platform_push_event(event);
+                Unicode_Decode decode = str_utf16_decode(at, end - at);
+                win32_push_character(decode.codepoint);
+                at += decode.advance;
             }
         } break;
 
@@ -332,6 +850,7 @@ LRESULT CALLBACK win32_window_proc(HWND window, UINT message, WPARAM wparam, LPA
             PAINTSTRUCT ps;
             BeginPaint(window, &ps);
             EndPaint(window, &ps);
+            platform_request_frame();
         } break;
 
         default: {
@@ -345,19 +864,15 @@ LRESULT CALLBACK win32_window_proc(HWND window, UINT message, WPARAM wparam, LPA
 
 int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR command_line, int show_code)
 {
-    LARGE_INTEGER perf_count_frequency_result;
-    QueryPerformanceFrequency(&perf_count_frequency_result);
-    perf_count_frequency = perf_count_frequency_result.QuadPart;
-    
     platform_state = &global_platform_state;
     {
         platform_state->window_width  = PLATFORM_DEFAULT_WINDOW_WIDTH;
         platform_state->window_height = PLATFORM_DEFAULT_WINDOW_HEIGHT;
         platform_state->running       = 1;
-        platform_state->event_count   = 0;
         platform_state->delta         = 0;
     }
-
+    platform_event_queue_init(&platform_state->events);
+    win32_init_key_table();
 
     WNDCLASSA window_class = {0};
     {
@@ -373,14 +888,17 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR command_li
         return -1;
     }
 
-    HWND window = CreateWindowA(window_class.lpszClassName,
-                                "app",
-                                WS_OVERLAPPEDWINDOW | WS_VISIBLE,
-                                CW_USEDEFAULT, CW_USEDEFAULT,
-                                platform_state->window_width, platform_state->window_height,
-                                0, 0, instance, 0);
+    Win32_Message_Thread message_thread = {0};
+    {
+        message_thread.instance   = instance;
+        message_thread.class_name = window_class.lpszClassName;
+    }
+    Platform_Thread message_thread_handle = platform_thread_create(win32_message_thread_proc, &message_thread, "Message Pump");
+    platform_thread_event_wait(&message_thread.window_created);
+    HWND window = message_thread.window;
 
     if (window == 0) {
+        platform_thread_join(message_thread_handle);
         return -1;
     }
 
@@ -390,21 +908,30 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR command_li
     app_init();
 
     ShowWindow(window, show_code);
-    UpdateWindow(window);
 
-    QueryPerformanceCounter(&last_counter);
-    
+    s32 viewport_width  = 0;
+    s32 viewport_height = 0;
+    // running is cleared by the message thread. Input comes in through
+    // the event queue, so waiting for the next frame blocks on that
+    // rather than on the message queue of this thread.
+    while (atomic_load_u32(&platform_state->running)) {
+        // Also starts the frame's time, idle time is not part of it.
+        platform_wait_for_frame();
+        if (!atomic_load_u32(&platform_state->running)) break;
 
-    while (platform_state->running) {
-        win32_process_pending_messages();
-        
-        update_delta_time();
+        win32_update_viewport(&viewport_width, &viewport_height);
 
         app_update();
     }
 
+    app_shutdown();
+
     wglMakeCurrent(global_window_dc, 0);
     wglDeleteContext(global_opengl_rc);
+    ReleaseDC(window, global_window_dc);
+
+    PostThreadMessageA(message_thread.thread_id, WM_QUIT, 0, 0);
+    platform_thread_join(message_thread_handle);
 
     return 0;
 }